@@ -0,0 +1,486 @@
+// Copyright 2023 Wenbo Zhang. Licensed under Apache-2.0.
+
+// Microbenchmarks for the span-creation entry points of the C and C++ API.
+//
+// Every case reports the wall time and the number of heap allocations made on
+// the calling thread per operation. The same case names are measured against
+// the Rust crate directly by `cargo bench --bench spans`, so the difference
+// between the two outputs is the cost of the FFI layer itself.
+//
+// Usage: bench_spans [iterations]
+
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "libfastrace.h"
+
+#ifdef FASTRACE_BENCH_COUNT_ALLOCS
+static thread_local uint64_t tl_allocs = 0;
+
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+int __real_posix_memalign(void** ptr, size_t align, size_t size);
+
+void* __wrap_malloc(size_t size) {
+  tl_allocs++;
+  return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size) {
+  tl_allocs++;
+  return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+  tl_allocs++;
+  return __real_realloc(ptr, size);
+}
+
+int __wrap_posix_memalign(void** ptr, size_t align, size_t size) {
+  tl_allocs++;
+  return __real_posix_memalign(ptr, align, size);
+}
+}  // extern "C"
+
+static uint64_t allocs() { return tl_allocs; }
+#else
+static uint64_t allocs() { return 0; }
+#endif
+
+namespace {
+
+// Spans are created in batches so that per-trace state (local span stacks,
+// buffered records) stays bounded. Setup and teardown of a batch are not
+// included in the measurement.
+constexpr size_t kBatch = 1024;
+
+const char* kKeys[] = {"k1", "k2", "k3", "k4"};
+const char* kVals[] = {"v1", "v2", "v3", "v4"};
+const ftr_prop kProps[] = {
+    FTR_STATIC_PROP("k1", "v1"), FTR_STATIC_PROP("k2", "v2"),
+    FTR_STATIC_PROP("k3", "v3"), FTR_STATIC_PROP("k4", "v4")};
+
+FILE* out = stdout;
+size_t iterations = 1000000;
+
+template <typename Op>
+void bench(const char* name, const std::function<void()>& begin_batch,
+           const std::function<void()>& end_batch, Op op) {
+  using clock = std::chrono::steady_clock;
+
+  // Warm up thread-locals, lazily initialized globals and caches.
+  begin_batch();
+  for (size_t i = 0; i < kBatch; i++) {
+    op();
+  }
+  end_batch();
+
+  clock::duration elapsed = clock::duration::zero();
+  uint64_t allocated = 0;
+  size_t done = 0;
+
+  while (done < iterations) {
+    begin_batch();
+    uint64_t a = allocs();
+    auto start = clock::now();
+    for (size_t i = 0; i < kBatch; i++) {
+      op();
+    }
+    elapsed += clock::now() - start;
+    allocated += allocs() - a;
+    end_batch();
+    done += kBatch;
+  }
+
+  double ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+  fprintf(out, "%-48s %10.1f ns/op %8.2f allocs/op\n", name, ns / done,
+          static_cast<double>(allocated) / done);
+  fflush(out);
+}
+
+ftr_span make_parent(bool noop, bool sampled) {
+  if (noop) {
+    return ftr_create_noop_span();
+  }
+  ftr_span_ctx ctx =
+      ftr_span_ctx_set_sampled(ftr_create_rand_span_ctx(), sampled);
+  return ftr_create_root_span("root", ctx);
+}
+
+// Runs a batch with a root span installed as the local parent of the current
+// thread, which is what `LocalSpan` and `*_enter_loc` need to record anything.
+struct LocalRoot {
+  LocalRoot(bool noop, bool sampled) {
+    root = make_parent(noop, sampled);
+    guard = ftr_set_loc_par_to_span(&root);
+  }
+
+  ~LocalRoot() {
+    ftr_destroy_loc_par_guar(guard);
+    ftr_destroy_span(root);
+  }
+
+  ftr_span root;
+  ftr_loc_par_guar guard;
+};
+
+// Measures every entry point with a noop, unsampled or sampled parent.
+void bench_suite(const char* mode, bool noop, bool sampled) {
+  char name[128];
+  ftr_span parent;
+  ftr_span parents[2];
+  std::vector<ftr_span> children;
+  children.reserve(kBatch);
+  LocalRoot* local = nullptr;
+  ftr_name_id child_name = ftr_register_name("child");
+  ftr_name_id local_name = ftr_register_name("local");
+
+  auto begin_parent = [&] { parent = make_parent(noop, sampled); };
+  auto end_parent = [&] {
+    for (auto& c : children) {
+      ftr_destroy_span(c);
+    }
+    children.clear();
+    ftr_destroy_span(parent);
+  };
+  auto begin_local = [&] { local = new LocalRoot(noop, sampled); };
+  auto end_local = [&] {
+    delete local;
+    local = nullptr;
+  };
+
+  fprintf(out, "# %s\n", mode);
+
+  snprintf(name, sizeof(name), "%s/ftr_create_root_span", mode);
+  bench(
+      name, [] {},
+      [&] {
+        for (auto& c : children) {
+          ftr_destroy_span(c);
+        }
+        children.clear();
+      },
+      [&] { children.push_back(make_parent(noop, sampled)); });
+
+  snprintf(name, sizeof(name), "%s/ftr_create_child_span_enter", mode);
+  bench(name, begin_parent, end_parent, [&] {
+    children.push_back(ftr_create_child_span_enter("child", &parent));
+  });
+
+  snprintf(name, sizeof(name), "%s/ftr_create_child_span_enter_id", mode);
+  bench(name, begin_parent, end_parent, [&] {
+    children.push_back(ftr_create_child_span_enter_id(child_name, &parent));
+  });
+
+  snprintf(name, sizeof(name), "%s/ftr_create_child_span_enter+destroy",
+           mode);
+  bench(name, begin_parent, end_parent, [&] {
+    ftr_destroy_span(ftr_create_child_span_enter("child", &parent));
+  });
+
+  snprintf(name, sizeof(name), "%s/ftr_create_child_span_enter_mul(2)", mode);
+  bench(
+      name,
+      [&] {
+        parents[0] = make_parent(noop, sampled);
+        parents[1] = make_parent(noop, sampled);
+      },
+      [&] {
+        for (auto& c : children) {
+          ftr_destroy_span(c);
+        }
+        children.clear();
+        ftr_destroy_span(parents[0]);
+        ftr_destroy_span(parents[1]);
+      },
+      [&] {
+        children.push_back(
+            ftr_create_child_span_enter_mul("child", parents, 2));
+      });
+
+  const char* batch_names[8] = {"child", "child", "child", "child",
+                                "child", "child", "child", "child"};
+  ftr_span batch[8];
+  snprintf(name, sizeof(name), "%s/ftr_create_child_spans_enter_batch(8)",
+           mode);
+  bench(name, begin_parent, end_parent, [&] {
+    ftr_create_child_spans_enter_batch(batch_names, 8, &parent, batch);
+    for (auto& c : batch) {
+      ftr_destroy_span(c);
+    }
+  });
+
+  snprintf(name, sizeof(name), "%s/ftr_create_child_span_enter(x8)", mode);
+  bench(name, begin_parent, end_parent, [&] {
+    for (auto& c : batch) {
+      c = ftr_create_child_span_enter("child", &parent);
+    }
+    for (auto& c : batch) {
+      ftr_destroy_span(c);
+    }
+  });
+
+  snprintf(name, sizeof(name), "%s/ftr_create_child_span_enter_loc", mode);
+  bench(name, begin_local, end_local, [&] {
+    ftr_destroy_span(ftr_create_child_span_enter_loc("child"));
+  });
+
+  snprintf(name, sizeof(name), "%s/ftr_create_loc_span_enter", mode);
+  bench(name, begin_local, end_local, [&] {
+    ftr_destroy_loc_span(ftr_create_loc_span_enter("local"));
+  });
+
+  snprintf(name, sizeof(name), "%s/ftr_create_loc_span_enter_id", mode);
+  bench(name, begin_local, end_local, [&] {
+    ftr_destroy_loc_span(ftr_create_loc_span_enter_id(local_name));
+  });
+
+  snprintf(name, sizeof(name), "%s/ftr_span_with_prop", mode);
+  bench(name, begin_parent, end_parent,
+        [&] { ftr_span_with_prop(&parent, "key", "value"); });
+
+  snprintf(name, sizeof(name), "%s/ftr_span_with_prop_i64", mode);
+  bench(name, begin_parent, end_parent,
+        [&] { ftr_span_with_prop_i64(&parent, "status", 200); });
+
+  snprintf(name, sizeof(name), "%s/ftr_span_with_props(4)", mode);
+  bench(name, begin_parent, end_parent,
+        [&] { ftr_span_with_props(&parent, kKeys, kVals, 4); });
+
+  snprintf(name, sizeof(name), "%s/ftr_span_with_props_ex(4 static)", mode);
+  bench(name, begin_parent, end_parent,
+        [&] { ftr_span_with_props_ex(&parent, kProps, 4); });
+
+  snprintf(name, sizeof(name), "%s/ftr_add_ent_to_par(4)", mode);
+  bench(name, begin_parent, end_parent,
+        [&] { ftr_add_ent_to_par("event", &parent, kKeys, kVals, 4); });
+
+  snprintf(name, sizeof(name), "%s/ftr_add_ent_to_par_ex(4 static)", mode);
+  bench(name, begin_parent, end_parent,
+        [&] { ftr_add_ent_to_par_ex("event", &parent, kProps, 4); });
+
+  snprintf(name, sizeof(name), "%s/ftr_loc_span_add_prop", mode);
+  bench(name, begin_local, end_local,
+        [&] { ftr_loc_span_add_prop("key", "value"); });
+
+  snprintf(name, sizeof(name), "%s/ftr_loc_span_add_props(4)", mode);
+  bench(name, begin_local, end_local,
+        [&] { ftr_loc_span_add_props(kKeys, kVals, 4); });
+
+  snprintf(name, sizeof(name), "%s/ftr_loc_span_add_props_ex(4 static)",
+           mode);
+  bench(name, begin_local, end_local,
+        [&] { ftr_loc_span_add_props_ex(kProps, 4); });
+
+  snprintf(name, sizeof(name), "%s/ftr_loc_span_with_prop", mode);
+  bench(name, begin_local, end_local, [&] {
+    ftr_loc_span ls = ftr_create_loc_span_enter("local");
+    ftr_loc_span_with_prop(&ls, "key", "value");
+    ftr_destroy_loc_span(ls);
+  });
+
+  snprintf(name, sizeof(name), "%s/ftr_loc_span_with_props(4)", mode);
+  bench(name, begin_local, end_local, [&] {
+    ftr_loc_span ls = ftr_create_loc_span_enter("local");
+    ftr_loc_span_with_props(&ls, kKeys, kVals, 4);
+    ftr_destroy_loc_span(ls);
+  });
+
+  snprintf(name, sizeof(name), "%s/ftr_add_ent_to_loc_par(4)", mode);
+  bench(name, begin_local, end_local,
+        [&] { ftr_add_ent_to_loc_par("event", kKeys, kVals, 4); });
+
+  // C++ wrapper, including the move paths spans take through task queues.
+  fastrace::Span* cxx_parent = nullptr;
+  auto begin_cxx = [&] {
+    if (noop) {
+      cxx_parent = new fastrace::Span();
+    } else {
+      fastrace::SpanContext ctx;
+      ctx.setSampled(sampled);
+      cxx_parent = new fastrace::Span("root", ctx);
+    }
+  };
+  auto end_cxx = [&] {
+    delete cxx_parent;
+    cxx_parent = nullptr;
+  };
+
+  snprintf(name, sizeof(name), "%s/fastrace::Span(name, parent)", mode);
+  bench(name, begin_cxx, end_cxx,
+        [&] { fastrace::Span s("child", *cxx_parent); });
+
+  snprintf(name, sizeof(name), "%s/fastrace::Span(Span&&)", mode);
+  bench(name, begin_cxx, end_cxx, [&] {
+    fastrace::Span s("child", *cxx_parent);
+    fastrace::Span moved(std::move(s));
+  });
+
+  snprintf(name, sizeof(name), "%s/fastrace::Span::operator=(Span&&)", mode);
+  bench(name, begin_cxx, end_cxx, [&] {
+    fastrace::Span s("child", *cxx_parent);
+    fastrace::Span moved;
+    moved = std::move(s);
+  });
+
+  snprintf(name, sizeof(name), "%s/fastrace::LocalSpan(name)", mode);
+  bench(name, begin_local, end_local, [&] { fastrace::LocalSpan ls("local"); });
+
+  snprintf(name, sizeof(name), "%s/FASTRACE_SCOPE(name)", mode);
+  bench(name, begin_local, end_local, [&] { FASTRACE_SCOPE("local"); });
+
+  snprintf(name, sizeof(name), "%s/fastrace::LocalSpan(LocalSpan&&)", mode);
+  bench(name, begin_local, end_local, [&] {
+    fastrace::LocalSpan ls("local");
+    fastrace::LocalSpan moved(std::move(ls));
+  });
+}
+
+// Creates and destroys child spans on several threads at once. Each thread
+// submits its finished spans through a queue of its own, so the time per span
+// should stay flat as threads are added.
+void bench_threads(const char* mode, bool sampled) {
+  using clock = std::chrono::steady_clock;
+  unsigned max_threads = std::min(8u, std::thread::hardware_concurrency());
+  char name[128];
+
+  for (unsigned threads = 1; threads <= std::max(1u, max_threads);
+       threads *= 2) {
+    std::vector<double> ns(threads);
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; t++) {
+      workers.emplace_back([&, t] {
+        size_t done = 0;
+        auto start = clock::now();
+        while (done < iterations) {
+          ftr_span root = make_parent(false, sampled);
+          for (size_t i = 0; i < kBatch; i++) {
+            ftr_destroy_span(ftr_create_child_span_enter("child", &root));
+          }
+          ftr_destroy_span(root);
+          done += kBatch;
+        }
+        ns[t] = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    clock::now() - start)
+                    .count() /
+                static_cast<double>(done);
+      });
+    }
+    for (auto& worker : workers) {
+      worker.join();
+    }
+
+    double total = 0;
+    for (double n : ns) {
+      total += n;
+    }
+    snprintf(name, sizeof(name),
+             "%s/ftr_create_child_span_enter+destroy x%u threads", mode,
+             threads);
+    fprintf(out, "%-48s %10.1f ns/op\n", name, total / threads);
+    fflush(out);
+  }
+}
+
+// Compares the clock timestamping the spans with the ones of the OS. A span
+// reads it twice, once when it starts and once when it ends.
+void bench_clocks() {
+  ftr_span span;
+  struct timespec ts;
+
+  fprintf(out, "# clock (%s)\n",
+          ftr_get_clock_source() == FTR_CLOCK_TSC ? "tsc" : "monotonic-coarse");
+
+  bench(
+      "clock/clock_gettime(MONOTONIC)", [] {}, [] {},
+      [&] { clock_gettime(CLOCK_MONOTONIC, &ts); });
+
+  bench(
+      "clock/clock_gettime(MONOTONIC_COARSE)", [] {}, [] {},
+      [&] { clock_gettime(CLOCK_MONOTONIC_COARSE, &ts); });
+
+  bench(
+      "clock/ftr_span_elapsed",
+      [&] { span = make_parent(false, true); },
+      [&] { ftr_destroy_span(span); },
+      [&] { ftr_span_elapsed(&span); });
+}
+
+// Encodes and decodes the context propagated with each RPC.
+void bench_propagation() {
+  ftr_span_ctx ctx = ftr_create_rand_span_ctx();
+  char traceparent[FTR_TRACEPARENT_LEN + 1];
+  uint8_t bin[FTR_SPAN_CTX_BIN_LEN];
+  ftr_span_ctx_encode_w3c(ctx, traceparent, sizeof(traceparent));
+  ftr_span_ctx_encode_bin(ctx, bin, sizeof(bin));
+
+  fprintf(out, "# propagation\n");
+
+  bench(
+      "propagation/ftr_span_ctx_encode_w3c", [] {}, [] {},
+      [&] { ftr_span_ctx_encode_w3c(ctx, traceparent, sizeof(traceparent)); });
+
+  bench(
+      "propagation/ftr_span_ctx_decode_w3c", [] {}, [] {},
+      [&] {
+        ftr_span_ctx_decode_w3c(traceparent, FTR_TRACEPARENT_LEN, &ctx);
+      });
+
+  bench(
+      "propagation/ftr_span_ctx_encode_bin", [] {}, [] {},
+      [&] { ftr_span_ctx_encode_bin(ctx, bin, sizeof(bin)); });
+
+  bench(
+      "propagation/ftr_span_ctx_decode_bin", [] {}, [] {},
+      [&] { ftr_span_ctx_decode_bin(bin, sizeof(bin), &ctx); });
+}
+
+}  // anonymous namespace
+
+int main(int argc, char** argv) {
+  if (argc > 1) {
+    iterations = strtoull(argv[1], nullptr, 10);
+  }
+
+  // The reporter used for the sampled cases writes every record to stdout.
+  // Keep our own results on the original stdout and send the reporter's output
+  // to /dev/null.
+  int saved = dup(STDOUT_FILENO);
+  int devnull = open("/dev/null", O_WRONLY);
+  if (saved < 0 || devnull < 0 || dup2(devnull, STDOUT_FILENO) < 0) {
+    perror("redirect stdout");
+    return 1;
+  }
+  close(devnull);
+  out = fdopen(saved, "w");
+
+  fprintf(out, "%zu iterations, batches of %zu\n", iterations, kBatch);
+
+  bench_suite("noop", true, true);
+  bench_suite("no-reporter", false, true);
+
+  ftr_set_cons_rptr();
+
+  bench_suite("unsampled", false, false);
+  bench_suite("sampled", false, true);
+  bench_threads("sampled", true);
+  bench_clocks();
+  bench_propagation();
+
+  ftr_flush();
+  return 0;
+}
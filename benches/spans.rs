@@ -0,0 +1,367 @@
+// Copyright 2023 Wenbo Zhang. Licensed under Apache-2.0.
+
+//! Baseline for `bench/bench_spans.cc`: the same cases measured against the
+//! Rust crate directly, without crossing the FFI layer.
+//!
+//! Usage: cargo bench --bench spans [-- iterations]
+
+use std::{
+    alloc::{GlobalAlloc, Layout, System},
+    cell::Cell,
+    io::Write,
+    os::fd::FromRawFd,
+    time::{Duration, Instant},
+};
+
+use fastrace::{
+    collector::{Config, ConsoleReporter},
+    prelude::{LocalSpan, Span, SpanContext},
+    Event,
+};
+
+struct CountingAlloc;
+
+thread_local! {
+    static ALLOCS: Cell<u64> = const { Cell::new(0) };
+}
+
+fn count() {
+    let _ = ALLOCS.try_with(|c| c.set(c.get() + 1));
+}
+
+unsafe impl GlobalAlloc for CountingAlloc {
+    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+        count();
+        System.alloc(layout)
+    }
+
+    unsafe fn alloc_zeroed(&self, layout: Layout) -> *mut u8 {
+        count();
+        System.alloc_zeroed(layout)
+    }
+
+    unsafe fn realloc(&self, ptr: *mut u8, layout: Layout, new_size: usize) -> *mut u8 {
+        count();
+        System.realloc(ptr, layout, new_size)
+    }
+
+    unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+        System.dealloc(ptr, layout)
+    }
+}
+
+#[global_allocator]
+static GLOBAL: CountingAlloc = CountingAlloc;
+
+fn allocs() -> u64 {
+    ALLOCS.with(|c| c.get())
+}
+
+/// Spans are created in batches so that per-trace state stays bounded.
+/// Setup and teardown of a batch are not included in the measurement.
+const BATCH: usize = 1024;
+
+const PROPS: [(&str, &str); 4] = [("k1", "v1"), ("k2", "v2"), ("k3", "v3"), ("k4", "v4")];
+
+struct Bench {
+    iterations: usize,
+    out: std::fs::File,
+}
+
+impl Bench {
+    fn run<S, T>(
+        &mut self,
+        name: &str,
+        mut setup: impl FnMut() -> S,
+        mut op: impl FnMut(&mut S) -> T,
+    ) {
+        let mut batch = |elapsed: &mut Duration, allocated: &mut u64| {
+            let mut state = setup();
+            let mut results = Vec::with_capacity(BATCH);
+            let a = allocs();
+            let start = Instant::now();
+            for _ in 0..BATCH {
+                results.push(op(&mut state));
+            }
+            *elapsed += start.elapsed();
+            *allocated += allocs() - a;
+            drop(results);
+            drop(state);
+        };
+
+        batch(&mut Duration::ZERO, &mut 0);
+
+        let mut elapsed = Duration::ZERO;
+        let mut allocated = 0;
+        let mut done = 0;
+        while done < self.iterations {
+            batch(&mut elapsed, &mut allocated);
+            done += BATCH;
+        }
+
+        writeln!(
+            self.out,
+            "{:<48} {:>10.1} ns/op {:>8.2} allocs/op",
+            name,
+            elapsed.as_nanos() as f64 / done as f64,
+            allocated as f64 / done as f64
+        )
+        .unwrap();
+    }
+
+    fn suite(&mut self, mode: &str, noop: bool, sampled: bool) {
+        let make_parent = move || {
+            if noop {
+                Span::noop()
+            } else {
+                Span::root("root", SpanContext::random().sampled(sampled))
+            }
+        };
+        let local_root = move || {
+            let root = make_parent();
+            let guard = root.set_local_parent();
+            (guard, root)
+        };
+
+        writeln!(self.out, "# {mode}").unwrap();
+
+        // `results` is pre-sized, so pushing the spans created by `op` does
+        // not allocate inside the timed region.
+        self.run(
+            &format!("{mode}/ftr_create_root_span"),
+            || (),
+            |_| make_parent(),
+        );
+
+        self.run(
+            &format!("{mode}/ftr_create_child_span_enter"),
+            make_parent,
+            |p| Span::enter_with_parent("child", p),
+        );
+
+        self.run(
+            &format!("{mode}/ftr_create_child_span_enter+destroy"),
+            make_parent,
+            |p| drop(Span::enter_with_parent("child", p)),
+        );
+
+        self.run(
+            &format!("{mode}/ftr_create_child_span_enter_mul(2)"),
+            || [make_parent(), make_parent()],
+            |p| Span::enter_with_parents("child", p.iter()),
+        );
+
+        // Both batch cases have the same Rust counterpart, there being no
+        // FFI crossing to save here.
+        for case in [
+            "ftr_create_child_spans_enter_batch(8)",
+            "ftr_create_child_span_enter(x8)",
+        ] {
+            self.run(&format!("{mode}/{case}"), make_parent, |p| {
+                drop(std::array::from_fn::<_, 8, _>(|_| {
+                    Span::enter_with_parent("child", p)
+                }))
+            });
+        }
+
+        self.run(
+            &format!("{mode}/ftr_create_child_span_enter_loc"),
+            local_root,
+            |_| drop(Span::enter_with_local_parent("child")),
+        );
+
+        self.run(
+            &format!("{mode}/ftr_create_loc_span_enter"),
+            local_root,
+            |_| drop(LocalSpan::enter_with_local_parent("local")),
+        );
+
+        self.run(&format!("{mode}/ftr_span_with_prop"), make_parent, |p| {
+            let owned = std::mem::take(p);
+            *p = owned.with_property(|| ("key", "value"));
+        });
+
+        self.run(
+            &format!("{mode}/ftr_span_with_props(4)"),
+            make_parent,
+            |p| {
+                let owned = std::mem::take(p);
+                *p = owned.with_properties(|| PROPS);
+            },
+        );
+
+        self.run(&format!("{mode}/ftr_add_ent_to_par(4)"), make_parent, |p| {
+            Event::add_to_parent("event", p, || PROPS)
+        });
+
+        self.run(&format!("{mode}/ftr_loc_span_add_prop"), local_root, |_| {
+            LocalSpan::add_property(|| ("key", "value"))
+        });
+
+        self.run(
+            &format!("{mode}/ftr_loc_span_add_props(4)"),
+            local_root,
+            |_| LocalSpan::add_properties(|| PROPS),
+        );
+
+        self.run(
+            &format!("{mode}/ftr_loc_span_with_prop"),
+            local_root,
+            |_| {
+                drop(LocalSpan::enter_with_local_parent("local").with_property(|| ("key", "value")))
+            },
+        );
+
+        self.run(
+            &format!("{mode}/ftr_loc_span_with_props(4)"),
+            local_root,
+            |_| drop(LocalSpan::enter_with_local_parent("local").with_properties(|| PROPS)),
+        );
+
+        self.run(
+            &format!("{mode}/ftr_add_ent_to_loc_par(4)"),
+            local_root,
+            |_| Event::add_to_local_parent("event", || PROPS),
+        );
+    }
+}
+
+/// Creates and destroys child spans on several threads at once, see
+/// `bench_threads` in `bench/bench_spans.cc`.
+fn bench_threads(bench: &mut Bench, mode: &str, sampled: bool) {
+    let max_threads = std::thread::available_parallelism().map_or(1, |n| n.get().min(8));
+    let iterations = bench.iterations;
+    let mut threads = 1;
+    while threads <= max_threads {
+        let ns: Vec<f64> = (0..threads)
+            .map(|_| {
+                std::thread::spawn(move || {
+                    let mut done = 0;
+                    let start = Instant::now();
+                    while done < iterations {
+                        let root = Span::root("root", SpanContext::random().sampled(sampled));
+                        for _ in 0..BATCH {
+                            drop(Span::enter_with_parent("child", &root));
+                        }
+                        drop(root);
+                        done += BATCH;
+                    }
+                    start.elapsed().as_nanos() as f64 / done as f64
+                })
+            })
+            .collect::<Vec<_>>()
+            .into_iter()
+            .map(|worker| worker.join().unwrap())
+            .collect();
+
+        writeln!(
+            bench.out,
+            "{:<48} {:>10.1} ns/op",
+            format!("{mode}/ftr_create_child_span_enter+destroy x{threads} threads"),
+            ns.iter().sum::<f64>() / threads as f64
+        )
+        .unwrap();
+        threads *= 2;
+    }
+}
+
+/// `bench_clocks` in `bench/bench_spans.cc`, plus the clock read by fastrace
+/// alone.
+fn bench_clocks(bench: &mut Bench) {
+    let source = if minstant::is_tsc_available() {
+        "tsc"
+    } else {
+        "monotonic-coarse"
+    };
+    writeln!(bench.out, "# clock ({source})").unwrap();
+
+    for (name, clock) in [
+        ("clock/clock_gettime(MONOTONIC)", libc::CLOCK_MONOTONIC),
+        (
+            "clock/clock_gettime(MONOTONIC_COARSE)",
+            libc::CLOCK_MONOTONIC_COARSE,
+        ),
+    ] {
+        bench.run(
+            name,
+            || (),
+            |_| unsafe {
+                let mut ts = std::mem::zeroed();
+                libc::clock_gettime(clock, &mut ts);
+                ts.tv_nsec
+            },
+        );
+    }
+
+    bench.run(
+        "clock/ftr_span_elapsed",
+        || Span::root("root", SpanContext::random()),
+        |span| span.elapsed(),
+    );
+
+    bench.run(
+        "clock/minstant::Instant::now",
+        || (),
+        |_| minstant::Instant::now(),
+    );
+}
+
+/// `bench_propagation` in `bench/bench_spans.cc`, against the W3C support of
+/// fastrace, which allocates the encoded string.
+fn bench_propagation(bench: &mut Bench) {
+    let ctx = SpanContext::random();
+    let traceparent = ctx.encode_w3c_traceparent();
+
+    writeln!(bench.out, "# propagation").unwrap();
+
+    bench.run(
+        "propagation/ftr_span_ctx_encode_w3c",
+        || (),
+        |_| ctx.encode_w3c_traceparent(),
+    );
+
+    bench.run(
+        "propagation/ftr_span_ctx_decode_w3c",
+        || (),
+        |_| SpanContext::decode_w3c_traceparent(&traceparent),
+    );
+}
+
+fn main() {
+    // `cargo bench` passes `--bench`; the only argument we care about is the
+    // iteration count.
+    let iterations = std::env::args()
+        .skip(1)
+        .find_map(|a| a.parse().ok())
+        .unwrap_or(1_000_000);
+
+    // Same as the C++ benchmark: the console reporter writes to /dev/null and
+    // the results go to the original stdout.
+    let out = unsafe {
+        let saved = libc::dup(libc::STDOUT_FILENO);
+        let devnull = libc::open(c"/dev/null".as_ptr(), libc::O_WRONLY);
+        assert!(saved >= 0 && devnull >= 0, "redirect stdout");
+        assert!(
+            libc::dup2(devnull, libc::STDOUT_FILENO) >= 0,
+            "redirect stdout"
+        );
+        libc::close(devnull);
+        std::fs::File::from_raw_fd(saved)
+    };
+
+    let mut bench = Bench { iterations, out };
+    writeln!(bench.out, "{iterations} iterations, batches of {BATCH}").unwrap();
+
+    bench.suite("noop", true, true);
+    bench.suite("no-reporter", false, true);
+
+    fastrace::set_reporter(ConsoleReporter, Config::default());
+
+    bench.suite("unsampled", false, false);
+    bench.suite("sampled", false, true);
+    bench_threads(&mut bench, "sampled", true);
+    bench_clocks(&mut bench);
+    bench_propagation(&mut bench);
+
+    fastrace::flush();
+}
@@ -50,7 +50,7 @@ static CQueue<data*> q;
 std::atomic<int> unfinished(2);
 
 void __attribute__((noinline)) baz(void* data) {
-  fastrace::LocalSpan ls("baz");
+  FASTRACE_FUNC_SPAN();
   std::this_thread::sleep_for(
       std::chrono::milliseconds((int)(unsigned long long)data * 1));
 }
@@ -73,7 +73,7 @@ void consume(const char* arg) {
 }
 
 void __attribute__((noinline)) wait(void) {
-  fastrace::LocalSpan ls("wait");
+  FASTRACE_FUNC_SPAN();
   while (1) {
     if (!std::atomic_load(&unfinished))
       break;
@@ -96,12 +96,12 @@ void __attribute__((noinline)) boo(void) {
 }
 
 void __attribute__((noinline)) bar(void) {
-  fastrace::LocalSpan ls("bar");
+  FASTRACE_FUNC_SPAN();
   boo();
 }
 
 void __attribute__((noinline)) foo(void) {
-  fastrace::LocalSpan ls("foo");
+  FASTRACE_FUNC_SPAN();
   bar();
 }
 
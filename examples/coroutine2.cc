@@ -0,0 +1,60 @@
+// Copyright 2023 Wenbo Zhang. Licensed under Apache-2.0.
+
+#include <libfastrace/libfastrace.h>
+
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <future>
+#include <thread>
+
+// A coroutine started right away, whose frame is freed once it finishes.
+struct Detached {
+  struct promise_type {
+    Detached get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+// Resumes the awaiting coroutine on a new thread.
+struct SwitchThread {
+  bool await_ready() { return false; }
+  void await_suspend(std::coroutine_handle<> handle) {
+    std::thread([handle] { handle.resume(); }).detach();
+  }
+  void await_resume() {}
+};
+
+Detached handle(const fastrace::Span& root, std::promise<void>& done) {
+  {
+    fastrace::Span span("handle", root);
+    fastrace::CoroutineLocalParent parent(span);
+    for (auto i = 1; i <= 3; i++) {
+      {
+        FASTRACE_SCOPE("step");
+        std::this_thread::sleep_for(std::chrono::milliseconds(i * 1));
+      }
+      // Each step runs on a thread of its own.
+      co_await parent.wrap(SwitchThread{});
+    }
+  }
+  done.set_value();
+}
+
+int main() {
+  fastrace::setConsoleReporter();
+
+  {
+    fastrace::SpanContext context;
+    fastrace::Span rootSpan("root", context);
+    std::promise<void> done;
+    handle(rootSpan, done);
+    done.get_future().wait();
+  }
+
+  fastrace::flush();
+  return 0;
+}
@@ -0,0 +1,46 @@
+// Copyright 2023 Wenbo Zhang. Licensed under Apache-2.0.
+
+#include <libfastrace/libfastrace.h>
+
+#include <cinttypes>
+#include <cstdio>
+#include <memory>
+
+// Prints each span on a line, straight from the views of the collector.
+class PrintingReporter : public fastrace::Reporter {
+ public:
+  void report(const ftr_span_view* spans, size_t n) override {
+    for (size_t i = 0; i < n; i++) {
+      const ftr_span_view& span = spans[i];
+      printf("%016" PRIx64 "%016" PRIx64 " %016" PRIx64 " <- %016" PRIx64
+             " %.*s %" PRIu64 "ns",
+             span.trace_id_high, span.trace_id_low, span.span_id,
+             span.parent_id, static_cast<int>(span.name.len), span.name.ptr,
+             span.duration_ns);
+      for (size_t j = 0; j < span.n_props; j++) {
+        printf(" %.*s=%.*s", static_cast<int>(span.props[j].key.len),
+               span.props[j].key.ptr, static_cast<int>(span.props[j].val.len),
+               span.props[j].val.ptr);
+      }
+      printf("\n");
+    }
+  }
+};
+
+int main() {
+  fastrace::setReporter(
+      std::unique_ptr<fastrace::Reporter>(new PrintingReporter()),
+      fastrace::createDefaultCollectorConfig());
+
+  {
+    fastrace::SpanContext context;
+    fastrace::Span root("root", context);
+    root.addProperty("user", "alice");
+
+    fastrace::Span child("child", root);
+    child.addProperty("attempt", 1);
+  }
+
+  fastrace::flush();
+  return 0;
+}
@@ -5,12 +5,12 @@
 #include <thread>
 
 void func2(int i) {
-  fastrace::LocalSpan ls("func2");
+  FASTRACE_FUNC_SPAN();
   std::this_thread::sleep_for(std::chrono::milliseconds(i * 1));
 }
 
 void func1(int i) {
-  fastrace::LocalSpan ls("func1");
+  FASTRACE_FUNC_SPAN();
   std::this_thread::sleep_for(std::chrono::milliseconds(i * 1));
   func2(i);
 }
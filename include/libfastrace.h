@@ -6,10 +6,25 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #ifdef __cplusplus
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
 #include <vector>
 
+/* Defined when the C++20 coroutine helpers, such as
+ * `fastrace::CoroutineLocalParent`, are available. */
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#define FTR_HAS_COROUTINES 1
+#include <coroutine>
+#include <utility>
+#endif
+#endif
+
 #include "lib.rs.h"
 
 extern "C" {
@@ -19,16 +34,100 @@ typedef struct ftr_span_ctx {
   uint64_t _padding[4];
 } ftr_span_ctx;
 
+typedef struct ftr_name_id {
+  uint64_t _padding[2];
+} ftr_name_id;
+
+/*
+ * Set in `_flags` of an `ftr_span` or `ftr_loc_span` that holds no span, such
+ * as a noop span, a span of an unsampled trace or a moved-from C++ wrapper.
+ * Empty spans are handled inline in this header without calling into the
+ * library, so instrumenting a request that is not sampled costs a flag check
+ * per call, and moving a span is a plain copy plus setting this flag on the
+ * source.
+ */
+#define FTR_SPAN_EMPTY (1u << 0)
+
+/*
+ * Set along with `FTR_SPAN_EMPTY` on a span of an unsampled trace. Such a span
+ * keeps its `ftr_span_ctx` in place of the Rust span, so the trace id and the
+ * sampling decision still propagate to its children and to
+ * `ftr_create_span_ctx`.
+ */
+#define FTR_SPAN_CTX (1u << 1)
+
+/*
+ * Number of local parents set on the current thread, through
+ * `ftr_set_loc_par_to_span` or `ftr_start_loc_coll`. Local span, property and
+ * event calls return right away while it is zero.
+ *
+ * Internal, only to be read by the inline functions below.
+ */
+extern __thread uint32_t ftr_loc_par_depth;
+
 typedef struct ftr_span {
   uint64_t _padding[18];
+  uint64_t _flags;
 } ftr_span;
 
+/*
+ * The empty span hiding the local parents of the current thread while
+ * `ftr_loc_par_depth` is zero, see `ftr_set_loc_par_to_span`, or NULL.
+ *
+ * Internal, only to be read by the inline functions below.
+ */
+extern __thread const ftr_span *ftr_loc_par_hidden;
+
+/*
+ * A property with explicit lengths, see `ftr_span_with_props_ex`.
+ *
+ * Neither `key` nor `val` needs to be NUL-terminated. `flags` tells how each
+ * of them is kept:
+ *
+ * - `FTR_PROP_KEY_STATIC` / `FTR_PROP_VAL_STATIC`: the string is valid UTF-8
+ *   and outlives the process, e.g. a string literal. It is borrowed, no copy
+ *   and no validation is made.
+ * - otherwise the string is copied once, with invalid UTF-8 replaced, before
+ *   the call returns.
+ *
+ * Keys starting with a NUL byte are reserved: such properties are ignored.
+ */
+typedef struct ftr_prop {
+  const char *key;
+  size_t key_len;
+  const char *val;
+  size_t val_len;
+  uint32_t flags;
+} ftr_prop;
+
+#define FTR_PROP_KEY_STATIC (1u << 0)
+#define FTR_PROP_VAL_STATIC (1u << 1)
+
+/*
+ * A finished span, see `ftr_create_child_spans_at`. The timestamps are in
+ * nanoseconds since the Unix epoch, as read from `CLOCK_REALTIME`.
+ */
+typedef struct ftr_timed_span {
+  const char *name;
+  uint64_t start_ns;
+  uint64_t end_ns;
+} ftr_timed_span;
+
+/* Builds an `ftr_prop` borrowing a string literal key and value. */
+#define FTR_STATIC_PROP(key, val)                                   \
+  {                                                                 \
+    (key), sizeof(key) - 1, (val), sizeof(val) - 1,                 \
+        FTR_PROP_KEY_STATIC | FTR_PROP_VAL_STATIC                   \
+  }
+
 typedef struct ftr_loc_par_guar {
   uint64_t _padding[3];
+  uint64_t _flags;
 } ftr_loc_par_guar;
 
 typedef struct ftr_loc_span {
   uint64_t _padding[3];
+  uint64_t _flags;
 } ftr_loc_span;
 
 typedef struct ftr_loc_spans {
@@ -40,50 +139,406 @@ typedef struct ftr_loc_coll {
 } ftr_loc_coll;
 
 typedef struct ftr_coll_cfg {
-  uint64_t _padding[5];
+  uint64_t _padding[56];
 } ftr_coll_cfg;
 
+/* What `ftr_set_queue_overflow` does with new spans when the queue is full. */
+typedef enum ftr_overflow {
+  /* Drop the new spans. */
+  FTR_OVERFLOW_DROP_NEWEST = 0,
+  /* Drop the oldest queued spans to make room. */
+  FTR_OVERFLOW_DROP_OLDEST = 1,
+  /* Wait for the reporter to make room. */
+  FTR_OVERFLOW_BLOCK = 2,
+} ftr_overflow;
+
+/* Number of buckets of the histograms in `ftr_collector_stats`. Bucket 0
+ * counts the zero values, bucket `i` the values in [2^(i-1), 2^i), and the
+ * last one everything above. */
+#define FTR_STATS_BUCKETS 24
+
+/* Counters of the collector, see `ftr_get_collector_stats`. */
+typedef struct ftr_collector_stats {
+  /* Spans recorded by the application threads, excluding noop spans and the
+   * spans of unsampled traces. */
+  uint64_t spans_created;
+  /* Spans handed over to the collector, once their trace finished. */
+  uint64_t spans_collected;
+  /* Spans handed to the reporter. */
+  uint64_t spans_reported;
+  /* Spans lost because the queue was full, their trace was over
+   * `ftr_set_max_bytes_per_trace`, or the reporter could not store them. */
+  uint64_t spans_dropped;
+  /* Spans of the traces discarded by tail sampling. */
+  uint64_t spans_sampled_out;
+  /* Spans waiting in the queue, and their estimated size. */
+  uint64_t queue_spans;
+  uint64_t queue_bytes;
+  /* Batches handed to the reporter, and the nanoseconds it spent on them. */
+  uint64_t batches;
+  uint64_t export_ns;
+  /* Histogram of the spans per batch. */
+  uint64_t batch_sizes[FTR_STATS_BUCKETS];
+  /* Histogram of the microseconds spent reporting a batch. */
+  uint64_t export_latencies_us[FTR_STATS_BUCKETS];
+  /* Exporter threads that could not be pinned, see `ftr_set_otlp_rt_cpus`. */
+  uint64_t exporter_threads_unpinned;
+} ftr_collector_stats;
+
 typedef struct ftr_otel_rptr {
-  uint64_t _padding[15];
+  uint64_t _padding[16];
 } ftr_otel_rptr;
 
 typedef struct ftr_otlp_exp_cfg {
-  uint64_t _padding[6];
+  uint64_t _padding[20];
 } ftr_otlp_exp_cfg;
 
+/* Transport of the OTLP exporter, see `ftr_set_otlp_protocol`. */
+typedef enum ftr_otlp_protocol {
+  FTR_OTLP_GRPC = 0,
+  FTR_OTLP_HTTP_PROTOBUF = 1,
+} ftr_otlp_protocol;
+
+/* Compression of the OTLP exports, see `ftr_set_otlp_compression`. */
+typedef enum ftr_otlp_compression {
+  FTR_OTLP_COMPRESSION_NONE = 0,
+  FTR_OTLP_COMPRESSION_GZIP = 1,
+  FTR_OTLP_COMPRESSION_ZSTD = 2,
+} ftr_otlp_compression;
+
+/* Clock timestamping the spans, see `ftr_get_clock_source`. */
+typedef enum ftr_clock_source {
+  /* The time stamp counter of the CPU, calibrated against the OS clock. */
+  FTR_CLOCK_TSC = 0,
+  /* `CLOCK_MONOTONIC_COARSE`, of a resolution of a scheduler tick. */
+  FTR_CLOCK_MONOTONIC_COARSE = 1,
+} ftr_clock_source;
+
+/* Drives the exporter runtime on the calling thread, never returns. See
+ * `ftr_set_otlp_rt_spawner`. */
+typedef void (*ftr_rt_run_fn)(void *arg);
+
+/* Called once to have `run(arg)` called on a thread of the application. */
+typedef void (*ftr_rt_spawn_fn)(ftr_rt_run_fn run, void *arg, void *user_data);
+
+/* Spans handed to the reporter and spans dropped by the collector during a
+ * flush, see `ftr_flush_async`, and spans still queued for the reporter when
+ * the flush stopped waiting for them. */
+typedef struct ftr_flush_stats {
+  uint64_t flushed;
+  uint64_t dropped;
+  uint64_t pending;
+} ftr_flush_stats;
+
+/* Called on the reporter thread once a flush queued by `ftr_flush_async` is
+ * done. */
+typedef void (*ftr_flush_cb)(ftr_flush_stats stats, void *user_data);
+
+/* A string of `len` bytes, not NUL-terminated. */
+typedef struct ftr_str {
+  const char *ptr;
+  size_t len;
+} ftr_str;
+
+typedef struct ftr_kv {
+  ftr_str key;
+  ftr_str val;
+} ftr_kv;
+
+typedef struct ftr_event_view {
+  ftr_str name;
+  uint64_t timestamp_unix_ns;
+  const ftr_kv *props;
+  size_t n_props;
+} ftr_event_view;
+
+/*
+ * A finished span handed to the reporter of `ftr_set_custom_rptr`. It borrows
+ * the strings of the span record, and is only valid during the call.
+ */
+typedef struct ftr_span_view {
+  uint64_t trace_id_high;
+  uint64_t trace_id_low;
+  uint64_t span_id;
+  /* 0 for a root span. */
+  uint64_t parent_id;
+  uint64_t begin_unix_ns;
+  uint64_t duration_ns;
+  ftr_str name;
+  const ftr_kv *props;
+  size_t n_props;
+  const ftr_event_view *events;
+  size_t n_events;
+} ftr_span_view;
+
+/* Receives a batch of `n` spans, see `ftr_set_custom_rptr`. */
+typedef void (*ftr_report_fn)(const ftr_span_view *spans, size_t n,
+                              void *user_data);
+
+/*
+ * A batch of finished spans laid out as columns, see `ftr_set_columnar_rptr`:
+ * the fields of span `i` are at index `i` of the per-span arrays, each of
+ * `n` entries. Strings are given as indexes into `strings`, which holds each
+ * distinct string of the batch once.
+ *
+ * The properties of span `i` are at indexes `props[i]` to `props[i + 1]`
+ * excluded of `prop_key` and `prop_val`, and its events at indexes
+ * `events[i]` to `events[i + 1]` excluded of the event arrays. The properties
+ * of event `j` are likewise at `event_props[j]` to `event_props[j + 1]` of
+ * `event_prop_key` and `event_prop_val`.
+ */
+typedef struct ftr_span_columns {
+  size_t n;
+  const uint64_t *trace_id_high;
+  const uint64_t *trace_id_low;
+  const uint64_t *span_id;
+  const uint64_t *parent_id;
+  const uint64_t *begin_unix_ns;
+  const uint64_t *duration_ns;
+  const uint32_t *name;
+  /* `n + 1` entries. */
+  const uint32_t *props;
+  const uint32_t *prop_key;
+  const uint32_t *prop_val;
+  /* `n + 1` entries. */
+  const uint32_t *events;
+  const uint32_t *event_name;
+  const uint64_t *event_timestamp_unix_ns;
+  /* `events[n] + 1` entries. */
+  const uint32_t *event_props;
+  const uint32_t *event_prop_key;
+  const uint32_t *event_prop_val;
+  const ftr_str *strings;
+  size_t n_strings;
+} ftr_span_columns;
+
+/* Receives a batch of spans, see `ftr_set_columnar_rptr`. */
+typedef void (*ftr_report_columns_fn)(const ftr_span_columns *batch,
+                                      void *user_data);
+
 /* Create a new `ftr_span_ctx` with a random trace id. */
 ftr_span_ctx ftr_create_rand_span_ctx();
 
-/* Creates a `ftr_span_ctx` from the given [`ftr_span`]. */
-ftr_span_ctx ftr_create_span_ctx(ftr_span const *span);
+ftr_span_ctx ftr_create_span_ctx_impl(ftr_span const *span);
+
+/*
+ * Creates a `ftr_span_ctx` from the given [`ftr_span`].
+ *
+ * A span of an unsampled trace returns its unsampled context. Any other empty
+ * span returns a random unsampled context.
+ */
+static inline ftr_span_ctx ftr_create_span_ctx(ftr_span const *span) {
+  if (span && span->_flags & FTR_SPAN_CTX) {
+    ftr_span_ctx ctx;
+    memcpy(&ctx, span->_padding, sizeof(ctx));
+    return ctx;
+  }
+  return ftr_create_span_ctx_impl(span);
+}
 
-/* Creates a `ftr_span_ctx` from the current local parent span. */
-ftr_span_ctx ftr_create_span_ctx_loc(void);
+ftr_span_ctx ftr_create_span_ctx_loc_impl(void);
+
+/*
+ * Creates a `ftr_span_ctx` from the current local parent span.
+ *
+ * While the local parent is hidden by an empty span, returns the context of
+ * that span as `ftr_create_span_ctx` does: unsampled, and random unless it
+ * belongs to an unsampled trace. Without a local parent, returns a random
+ * unsampled context.
+ */
+static inline ftr_span_ctx ftr_create_span_ctx_loc(void) {
+  if (!ftr_loc_par_depth) {
+    return ftr_create_span_ctx(ftr_loc_par_hidden);
+  }
+  return ftr_create_span_ctx_loc_impl();
+}
 
 /* Sets the `sampled` flag of the `SpanContext`. */
 ftr_span_ctx ftr_span_ctx_set_sampled(ftr_span_ctx ctx, bool sampled);
 
-/* Create a place-holder span that never starts recording. */
-ftr_span ftr_create_noop_span();
+/* Length of a W3C `traceparent` value, without the terminating NUL. */
+#define FTR_TRACEPARENT_LEN 55
+
+/*
+ * Writes `ctx` as a W3C `traceparent` header value to `buf`, NUL-terminated if
+ * `len` leaves room for it. Returns the length of the value,
+ * `FTR_TRACEPARENT_LEN`, or 0 if `len` is too short. Does not allocate.
+ */
+size_t ftr_span_ctx_encode_w3c(ftr_span_ctx ctx, char *buf, size_t len);
+
+/*
+ * Parses the W3C `traceparent` header value of `len` bytes at `value` into
+ * `ctx`. Returns false, leaving `ctx` untouched, if the value is malformed or
+ * its trace id or parent id is all zeros. Does not allocate.
+ */
+bool ftr_span_ctx_decode_w3c(const char *value, size_t len, ftr_span_ctx *ctx);
+
+/* Length of the binary encoding of a span context. */
+#define FTR_SPAN_CTX_BIN_LEN 26
+
+/*
+ * Writes the binary encoding of `ctx` to `buf`, for propagation in the
+ * headers of internal protocols: a version byte of 0, the trace id and the
+ * span id in big-endian order, then a flags byte, 0x01 if sampled. Returns
+ * `FTR_SPAN_CTX_BIN_LEN`, or 0 if `len` is too short.
+ */
+size_t ftr_span_ctx_encode_bin(ftr_span_ctx ctx, uint8_t *buf, size_t len);
+
+/*
+ * Parses the binary encoding at the start of the `len` bytes at `buf` into
+ * `ctx`. Returns false, leaving `ctx` untouched, if `len` is too short, the
+ * version is not 0 or an id is zero.
+ */
+bool ftr_span_ctx_decode_bin(const uint8_t *buf, size_t len, ftr_span_ctx *ctx);
+
+/* Create a place-holder span that never starts recording. This is an empty
+ * span, see `FTR_SPAN_EMPTY`. */
+static inline ftr_span ftr_create_noop_span(void) {
+  ftr_span span = {{0}, FTR_SPAN_EMPTY};
+  return span;
+}
+
+/*
+ * Register a span name once and return a handle for the `*_id` span
+ * constructors.
+ *
+ * The name is validated and copied here, so the `*_id` constructors neither
+ * scan nor copy it again. Registering the same name again returns the same
+ * handle. Registered names live until the process exits, so this is meant for
+ * a bounded set of names, e.g. one per call site.
+ */
+ftr_name_id ftr_register_name(const char *name);
 
 /*
  * Create a new trace and return its root span.
  *
  * Once destroyed (dropped), the root span automatically submits all associated
  * child spans to the reporter.
+ *
+ * If `parent` is not sampled, an empty span carrying an unsampled context is
+ * returned, see `FTR_SPAN_CTX`.
  */
 ftr_span ftr_create_root_span(const char *name, ftr_span_ctx parent);
 
-/* Create a new child span associated with the specified parent span. */
-ftr_span ftr_create_child_span_enter(const char *name, ftr_span const *parent);
+ftr_span ftr_create_child_span_enter_impl(const char *name,
+                                          ftr_span const *parent);
 
-/* Create a new child span associated with multiple parent spans. */
+/*
+ * Create a new child span associated with the specified parent span.
+ *
+ * The parent is passed by pointer all the way into Rust. A NULL parent yields
+ * an empty span, and an empty parent yields a copy of itself, so children of
+ * an unsampled span carry on its context.
+ */
+static inline ftr_span ftr_create_child_span_enter(const char *name,
+                                                   ftr_span const *parent) {
+  if (!parent) {
+    return ftr_create_noop_span();
+  }
+  if (parent->_flags & FTR_SPAN_EMPTY) {
+    return *parent;
+  }
+  return ftr_create_child_span_enter_impl(name, parent);
+}
+
+/*
+ * Create a new child span associated with multiple parent spans.
+ *
+ * If every parent is empty, returns a copy of the first one of an unsampled
+ * trace, or an empty span, as `ftr_create_child_span_enter` does.
+ */
 ftr_span ftr_create_child_span_enter_mul(const char *name,
                                          ftr_span const *parents, size_t n);
 
+void ftr_create_child_spans_enter_batch_impl(const char *const *names, size_t n,
+                                             ftr_span const *parent,
+                                             ftr_span *out);
+
+/*
+ * Create `n` child spans of `parent` at once into `out`, the i-th one named
+ * `names[i]`, e.g. one per shard of a scatter-gather query. Same as calling
+ * `ftr_create_child_span_enter` `n` times, with a single call into the
+ * library.
+ */
+static inline void ftr_create_child_spans_enter_batch(const char *const *names,
+                                                      size_t n,
+                                                      ftr_span const *parent,
+                                                      ftr_span *out) {
+  if (!parent || parent->_flags & FTR_SPAN_EMPTY) {
+    for (size_t i = 0; i < n; i++) {
+      out[i] = parent ? *parent : ftr_create_noop_span();
+    }
+    return;
+  }
+  ftr_create_child_spans_enter_batch_impl(names, n, parent, out);
+}
+
+ftr_span ftr_create_child_span_enter_loc_impl(const char *name);
+
 /* Create a new child span associated with the current local span in the current
  * thread. */
-ftr_span ftr_create_child_span_enter_loc(const char *name);
+static inline ftr_span ftr_create_child_span_enter_loc(const char *name) {
+  if (!ftr_loc_par_depth) {
+    return ftr_create_noop_span();
+  }
+  return ftr_create_child_span_enter_loc_impl(name);
+}
+
+/* Same as `ftr_create_root_span`, with a name from `ftr_register_name`. */
+ftr_span ftr_create_root_span_id(ftr_name_id name, ftr_span_ctx parent);
+
+ftr_span ftr_create_child_span_enter_id_impl(ftr_name_id name,
+                                             ftr_span const *parent);
+
+/* Same as `ftr_create_child_span_enter`, with a name from
+ * `ftr_register_name`. */
+static inline ftr_span ftr_create_child_span_enter_id(ftr_name_id name,
+                                                      ftr_span const *parent) {
+  if (!parent) {
+    return ftr_create_noop_span();
+  }
+  if (parent->_flags & FTR_SPAN_EMPTY) {
+    return *parent;
+  }
+  return ftr_create_child_span_enter_id_impl(name, parent);
+}
+
+/* Same as `ftr_create_child_span_enter_mul`, with a name from
+ * `ftr_register_name`. */
+ftr_span ftr_create_child_span_enter_mul_id(ftr_name_id name,
+                                            ftr_span const *parents, size_t n);
+
+void ftr_create_child_spans_enter_batch_id_impl(ftr_name_id const *names,
+                                                size_t n,
+                                                ftr_span const *parent,
+                                                ftr_span *out);
+
+/* Same as `ftr_create_child_spans_enter_batch`, with names from
+ * `ftr_register_name`. */
+static inline void ftr_create_child_spans_enter_batch_id(
+    ftr_name_id const *names, size_t n, ftr_span const *parent,
+    ftr_span *out) {
+  if (!parent || parent->_flags & FTR_SPAN_EMPTY) {
+    for (size_t i = 0; i < n; i++) {
+      out[i] = parent ? *parent : ftr_create_noop_span();
+    }
+    return;
+  }
+  ftr_create_child_spans_enter_batch_id_impl(names, n, parent, out);
+}
+
+ftr_span ftr_create_child_span_enter_loc_id_impl(ftr_name_id name);
+
+/* Same as `ftr_create_child_span_enter_loc`, with a name from
+ * `ftr_register_name`. */
+static inline ftr_span ftr_create_child_span_enter_loc_id(ftr_name_id name) {
+  if (!ftr_loc_par_depth) {
+    return ftr_create_noop_span();
+  }
+  return ftr_create_child_span_enter_loc_id_impl(name);
+}
+
+void ftr_cancel_span_impl(ftr_span *span);
 
 /*
  * Dismisses the trace, preventing the reporting of any span records associated
@@ -91,18 +546,53 @@ ftr_span ftr_create_child_span_enter_loc(const char *name);
  *
  * This is particularly useful when focusing on the tail latency of a program.
  * For instant, you can dismiss all traces finishes within the 99th percentile.
+ * `ftr_set_tail_percentile` does this for you in the collector.
  *
  * # Note
  *
  * This method only dismisses the entire trace when called on the root span.
  * If called on a non-root span, it will only cancel the reporting of that
  * specific span.
+ *
+ * The span is consumed and marked `FTR_SPAN_EMPTY`, so a later
+ * `ftr_destroy_span` on it does nothing.
  */
-void ftr_cancel_span(ftr_span span);
+static inline void ftr_cancel_span(ftr_span *span) {
+  if (!(span->_flags & FTR_SPAN_EMPTY)) {
+    ftr_cancel_span_impl(span);
+  }
+}
+
+uint64_t ftr_span_elapsed_impl(ftr_span const *span);
+
+/* Returns the time elapsed since the span was created in nanoseconds, or 0 for
+ * an empty span. Read from the clock of `ftr_get_clock_source`. */
+static inline uint64_t ftr_span_elapsed(ftr_span const *span) {
+  if (span->_flags & FTR_SPAN_EMPTY) {
+    return 0;
+  }
+  return ftr_span_elapsed_impl(span);
+}
+
+void ftr_destroy_span_impl(ftr_span *span);
+
+/*
+ * Once destroyed (dropped), the root span automatically submits all associated
+ * child spans to the reporter.
+ *
+ * A destroyed span is handed to the collector through a lock-free
+ * single-producer queue owned by the destroying thread, which the collector
+ * drains in batches, so spans ending on many threads at once do not contend.
+ * Spans of the same thread can also be batched ahead of that queue, by setting
+ * a span as the local parent and creating `ftr_loc_span`s under it.
+ */
+static inline void ftr_destroy_span(ftr_span span) {
+  if (!(span._flags & FTR_SPAN_EMPTY)) {
+    ftr_destroy_span_impl(&span);
+  }
+}
 
-/* Once destroyed (dropped), the root span automatically submits all associated
- * child spans to the reporter. */
-void ftr_destroy_span(ftr_span span);
+ftr_loc_par_guar ftr_set_loc_par_to_span_impl(ftr_span const *span);
 
 /*
  * Sets the current `ftr_pan` as the local parent for the current thread.
@@ -113,25 +603,135 @@ void ftr_destroy_span(ftr_span span);
  * A local parent is necessary for creating a [`ftr_local_span`] using
  * [`ftr_create_loc_span_enter()`]. If no local parent is set,
  * `ftr_create_loc_span_enter()` will not perform any action.
+ *
+ * An empty span hides the enclosing local parent, if any, until the guard is
+ * destroyed, so local spans under it are dropped without calling into Rust.
  */
-ftr_loc_par_guar ftr_set_loc_par_to_span(ftr_span const *span);
+static inline ftr_loc_par_guar ftr_set_loc_par_to_span(ftr_span const *span) {
+  if (!span || span->_flags & FTR_SPAN_EMPTY) {
+    ftr_loc_par_guar guard = {
+        {ftr_loc_par_depth, (uint64_t)(uintptr_t)ftr_loc_par_hidden},
+        FTR_SPAN_EMPTY};
+    ftr_loc_par_depth = 0;
+    ftr_loc_par_hidden = span;
+    return guard;
+  }
+  return ftr_set_loc_par_to_span_impl(span);
+}
+
+void ftr_span_with_prop_impl(ftr_span *span, const char *key, const char *val);
 
 /*
  * Add a single property to the `Span` and return the modified `Span`.
  *
  * A property is an arbitrary key-value pair associated with a span.
  */
-void ftr_span_with_prop(ftr_span *span, const char *key, const char *val);
+static inline void ftr_span_with_prop(ftr_span *span, const char *key,
+                                      const char *val) {
+  if (!(span->_flags & FTR_SPAN_EMPTY)) {
+    ftr_span_with_prop_impl(span, key, val);
+  }
+}
+
+void ftr_span_with_props_impl(ftr_span *span, const char **keys,
+                              const char **vals, size_t n);
 
 /* Add multiple properties to the `Span` and return the modified `Span`. */
-void ftr_span_with_props(ftr_span *span, const char **keys, const char **vals,
-                         size_t n);
+static inline void ftr_span_with_props(ftr_span *span, const char **keys,
+                                       const char **vals, size_t n) {
+  if (!(span->_flags & FTR_SPAN_EMPTY)) {
+    ftr_span_with_props_impl(span, keys, vals, n);
+  }
+}
+
+void ftr_span_with_prop_i64_impl(ftr_span *span, const char *key, int64_t val);
+void ftr_span_with_prop_u64_impl(ftr_span *span, const char *key, uint64_t val);
+void ftr_span_with_prop_f64_impl(ftr_span *span, const char *key, double val);
+void ftr_span_with_prop_bool_impl(ftr_span *span, const char *key, bool val);
+
+/*
+ * Same as `ftr_span_with_prop`, with a typed value.
+ *
+ * The value is passed in binary and only formatted if the span is recorded, so
+ * callers don't need to format it into a buffer of their own.
+ */
+static inline void ftr_span_with_prop_i64(ftr_span *span, const char *key,
+                                          int64_t val) {
+  if (!(span->_flags & FTR_SPAN_EMPTY)) {
+    ftr_span_with_prop_i64_impl(span, key, val);
+  }
+}
+
+static inline void ftr_span_with_prop_u64(ftr_span *span, const char *key,
+                                          uint64_t val) {
+  if (!(span->_flags & FTR_SPAN_EMPTY)) {
+    ftr_span_with_prop_u64_impl(span, key, val);
+  }
+}
+
+static inline void ftr_span_with_prop_f64(ftr_span *span, const char *key,
+                                          double val) {
+  if (!(span->_flags & FTR_SPAN_EMPTY)) {
+    ftr_span_with_prop_f64_impl(span, key, val);
+  }
+}
+
+static inline void ftr_span_with_prop_bool(ftr_span *span, const char *key,
+                                           bool val) {
+  if (!(span->_flags & FTR_SPAN_EMPTY)) {
+    ftr_span_with_prop_bool_impl(span, key, val);
+  }
+}
+
+void ftr_span_with_props_ex_impl(ftr_span *span, const ftr_prop *props,
+                                 size_t n);
+
+/*
+ * Add multiple properties with explicit lengths to the `Span`.
+ *
+ * Keys and values flagged as static are borrowed, so tagging a span with
+ * literals makes no heap allocation. See `ftr_prop`.
+ */
+static inline void ftr_span_with_props_ex(ftr_span *span, const ftr_prop *props,
+                                          size_t n) {
+  if (!(span->_flags & FTR_SPAN_EMPTY)) {
+    ftr_span_with_props_ex_impl(span, props, n);
+  }
+}
+
+void ftr_add_ent_to_par_impl(const char *name, ftr_span *span,
+                             const char **keys, const char **vals, size_t n);
 
 /* Adds an event to the parent span with the given name and properties. */
-void ftr_add_ent_to_par(const char *name, ftr_span *span, const char **keys,
-                        const char **vals, size_t n);
+static inline void ftr_add_ent_to_par(const char *name, ftr_span *span,
+                                      const char **keys, const char **vals,
+                                      size_t n) {
+  if (!(span->_flags & FTR_SPAN_EMPTY)) {
+    ftr_add_ent_to_par_impl(name, span, keys, vals, n);
+  }
+}
 
-void ftr_destroy_loc_par_guar(ftr_loc_par_guar guard);
+void ftr_add_ent_to_par_ex_impl(const char *name, ftr_span *span,
+                                const ftr_prop *props, size_t n);
+
+/* Same as `ftr_add_ent_to_par`, with properties of explicit lengths. */
+static inline void ftr_add_ent_to_par_ex(const char *name, ftr_span *span,
+                                         const ftr_prop *props, size_t n) {
+  if (!(span->_flags & FTR_SPAN_EMPTY)) {
+    ftr_add_ent_to_par_ex_impl(name, span, props, n);
+  }
+}
+
+void ftr_destroy_loc_par_guar_impl(ftr_loc_par_guar *guard);
+
+static inline void ftr_destroy_loc_par_guar(ftr_loc_par_guar guard) {
+  if (guard._flags & FTR_SPAN_EMPTY) {
+    ftr_loc_par_depth = (uint32_t)guard._padding[0];
+    ftr_loc_par_hidden = (const ftr_span *)(uintptr_t)guard._padding[1];
+    return;
+  }
+  ftr_destroy_loc_par_guar_impl(&guard);
+}
 
 /*
  * Attach a collection of [`ftr_local_span`] instances as child spans to the
@@ -161,47 +761,237 @@ void ftr_destroy_loc_par_guar(ftr_loc_par_guar guard);
 void ftr_push_child_spans_to_cur(ftr_span const *span,
                                  ftr_loc_spans local_span);
 
+void ftr_create_child_spans_at_impl(ftr_span const *parent,
+                                    ftr_timed_span const *spans, size_t n);
+
+/*
+ * Records `n` finished child spans of `parent` from timestamps taken earlier
+ * by the application, e.g. when a request was received and when it was
+ * dispatched, without creating them while they run. They are recorded
+ * together through `ftr_push_child_spans_to_cur`, and reported with the trace
+ * of `parent`. Names must stay valid until then, like the other span names.
+ * Nothing is recorded under a NULL or empty parent.
+ */
+static inline void ftr_create_child_spans_at(ftr_span const *parent,
+                                             ftr_timed_span const *spans,
+                                             size_t n) {
+  if (!parent || parent->_flags & FTR_SPAN_EMPTY) {
+    return;
+  }
+  ftr_create_child_spans_at_impl(parent, spans, n);
+}
+
+/* Records a single finished child span, see `ftr_create_child_spans_at`. */
+static inline void ftr_create_child_span_at(const char *name,
+                                            ftr_span const *parent,
+                                            uint64_t start_ns,
+                                            uint64_t end_ns) {
+  ftr_timed_span span = {name, start_ns, end_ns};
+  ftr_create_child_spans_at(parent, &span, 1);
+}
+
+ftr_loc_span ftr_create_loc_span_enter_impl(const char *name);
+
 /*
  * Create a new child span associated with the current local span in the current
  * thread, and then it will become the new local parent.
+ *
+ * Without a local parent, an empty local span is returned.
  */
-ftr_loc_span ftr_create_loc_span_enter(const char *name);
+static inline ftr_loc_span ftr_create_loc_span_enter(const char *name) {
+  if (!ftr_loc_par_depth) {
+    ftr_loc_span span = {{0}, FTR_SPAN_EMPTY};
+    return span;
+  }
+  return ftr_create_loc_span_enter_impl(name);
+}
+
+ftr_loc_span ftr_create_loc_span_enter_id_impl(ftr_name_id name);
+
+/* Same as `ftr_create_loc_span_enter`, with a name from `ftr_register_name`. */
+static inline ftr_loc_span ftr_create_loc_span_enter_id(ftr_name_id name) {
+  if (!ftr_loc_par_depth) {
+    ftr_loc_span span = {{0}, FTR_SPAN_EMPTY};
+    return span;
+  }
+  return ftr_create_loc_span_enter_id_impl(name);
+}
+
+void ftr_loc_span_add_prop_impl(const char *key, const char *val);
 
 /*
  * Add a single property to the current local parent.If the local parent is
  * a[`Span`], the property will be added to the `Span`.
  */
-void ftr_loc_span_add_prop(const char *key, const char *val);
+static inline void ftr_loc_span_add_prop(const char *key, const char *val) {
+  if (ftr_loc_par_depth) {
+    ftr_loc_span_add_prop_impl(key, val);
+  }
+}
+
+void ftr_loc_span_add_prop_i64_impl(const char *key, int64_t val);
+void ftr_loc_span_add_prop_u64_impl(const char *key, uint64_t val);
+void ftr_loc_span_add_prop_f64_impl(const char *key, double val);
+void ftr_loc_span_add_prop_bool_impl(const char *key, bool val);
+
+/* Same as `ftr_loc_span_add_prop`, with a typed value. */
+static inline void ftr_loc_span_add_prop_i64(const char *key, int64_t val) {
+  if (ftr_loc_par_depth) {
+    ftr_loc_span_add_prop_i64_impl(key, val);
+  }
+}
+
+static inline void ftr_loc_span_add_prop_u64(const char *key, uint64_t val) {
+  if (ftr_loc_par_depth) {
+    ftr_loc_span_add_prop_u64_impl(key, val);
+  }
+}
+
+static inline void ftr_loc_span_add_prop_f64(const char *key, double val) {
+  if (ftr_loc_par_depth) {
+    ftr_loc_span_add_prop_f64_impl(key, val);
+  }
+}
+
+static inline void ftr_loc_span_add_prop_bool(const char *key, bool val) {
+  if (ftr_loc_par_depth) {
+    ftr_loc_span_add_prop_bool_impl(key, val);
+  }
+}
+
+void ftr_loc_span_add_props_impl(const char **keys, const char **val, size_t n);
 
 /*
  * Add multiple properties to the current local parent. If the local parent is a
  * [`Span`], the properties will be added to the `Span`.
  */
-void ftr_loc_span_add_props(const char **keys, const char **val, size_t n);
+static inline void ftr_loc_span_add_props(const char **keys, const char **val,
+                                          size_t n) {
+  if (ftr_loc_par_depth) {
+    ftr_loc_span_add_props_impl(keys, val, n);
+  }
+}
+
+void ftr_loc_span_add_props_ex_impl(const ftr_prop *props, size_t n);
+
+/* Same as `ftr_loc_span_add_props`, with properties of explicit lengths. */
+static inline void ftr_loc_span_add_props_ex(const ftr_prop *props, size_t n) {
+  if (ftr_loc_par_depth) {
+    ftr_loc_span_add_props_ex_impl(props, n);
+  }
+}
+
+void ftr_loc_span_with_prop_impl(ftr_loc_span *span, const char *key,
+                                 const char *val);
 
 /*
  * Add a single property to the `LocalSpan` and return the modified `LocalSpan`.
  *
  * A property is an arbitrary key - value pair associated with a span.
  */
-void ftr_loc_span_with_prop(ftr_loc_span *span, const char *key,
-                            const char *val);
+static inline void ftr_loc_span_with_prop(ftr_loc_span *span, const char *key,
+                                          const char *val) {
+  if (!(span->_flags & FTR_SPAN_EMPTY)) {
+    ftr_loc_span_with_prop_impl(span, key, val);
+  }
+}
+
+void ftr_loc_span_with_prop_i64_impl(ftr_loc_span *span, const char *key,
+                                     int64_t val);
+void ftr_loc_span_with_prop_u64_impl(ftr_loc_span *span, const char *key,
+                                     uint64_t val);
+void ftr_loc_span_with_prop_f64_impl(ftr_loc_span *span, const char *key,
+                                     double val);
+void ftr_loc_span_with_prop_bool_impl(ftr_loc_span *span, const char *key,
+                                      bool val);
+
+/* Same as `ftr_loc_span_with_prop`, with a typed value. */
+static inline void ftr_loc_span_with_prop_i64(ftr_loc_span *span,
+                                              const char *key, int64_t val) {
+  if (!(span->_flags & FTR_SPAN_EMPTY)) {
+    ftr_loc_span_with_prop_i64_impl(span, key, val);
+  }
+}
+
+static inline void ftr_loc_span_with_prop_u64(ftr_loc_span *span,
+                                              const char *key, uint64_t val) {
+  if (!(span->_flags & FTR_SPAN_EMPTY)) {
+    ftr_loc_span_with_prop_u64_impl(span, key, val);
+  }
+}
+
+static inline void ftr_loc_span_with_prop_f64(ftr_loc_span *span,
+                                              const char *key, double val) {
+  if (!(span->_flags & FTR_SPAN_EMPTY)) {
+    ftr_loc_span_with_prop_f64_impl(span, key, val);
+  }
+}
+
+static inline void ftr_loc_span_with_prop_bool(ftr_loc_span *span,
+                                               const char *key, bool val) {
+  if (!(span->_flags & FTR_SPAN_EMPTY)) {
+    ftr_loc_span_with_prop_bool_impl(span, key, val);
+  }
+}
+
+void ftr_loc_span_with_props_impl(ftr_loc_span *span, const char **keys,
+                                  const char **vals, size_t n);
 
 /*
  * Add multiple properties to the `LocalSpan` and return the modified
  * `LocalSpan`.
  */
-void ftr_loc_span_with_props(ftr_loc_span *span, const char **keys,
-                             const char **vals, size_t n);
+static inline void ftr_loc_span_with_props(ftr_loc_span *span,
+                                           const char **keys, const char **vals,
+                                           size_t n) {
+  if (!(span->_flags & FTR_SPAN_EMPTY)) {
+    ftr_loc_span_with_props_impl(span, keys, vals, n);
+  }
+}
+
+void ftr_loc_span_with_props_ex_impl(ftr_loc_span *span, const ftr_prop *props,
+                                     size_t n);
+
+/* Same as `ftr_loc_span_with_props`, with properties of explicit lengths. */
+static inline void ftr_loc_span_with_props_ex(ftr_loc_span *span,
+                                              const ftr_prop *props, size_t n) {
+  if (!(span->_flags & FTR_SPAN_EMPTY)) {
+    ftr_loc_span_with_props_ex_impl(span, props, n);
+  }
+}
+
+void ftr_add_ent_to_loc_par_impl(const char *name, const char **keys,
+                                 const char **vals, size_t n);
 
 /*
  * Adds an event to the current local parent span with the given name and
  * properties.
  */
-void ftr_add_ent_to_loc_par(const char *name, const char **keys,
-                            const char **vals, size_t n);
+static inline void ftr_add_ent_to_loc_par(const char *name, const char **keys,
+                                          const char **vals, size_t n) {
+  if (ftr_loc_par_depth) {
+    ftr_add_ent_to_loc_par_impl(name, keys, vals, n);
+  }
+}
+
+void ftr_add_ent_to_loc_par_ex_impl(const char *name, const ftr_prop *props,
+                                    size_t n);
 
-void ftr_destroy_loc_span(ftr_loc_span span);
+/* Same as `ftr_add_ent_to_loc_par`, with properties of explicit lengths. */
+static inline void ftr_add_ent_to_loc_par_ex(const char *name,
+                                             const ftr_prop *props, size_t n) {
+  if (ftr_loc_par_depth) {
+    ftr_add_ent_to_loc_par_ex_impl(name, props, n);
+  }
+}
+
+void ftr_destroy_loc_span_impl(ftr_loc_span *span);
+
+static inline void ftr_destroy_loc_span(ftr_loc_span span) {
+  if (!(span._flags & FTR_SPAN_EMPTY)) {
+    ftr_destroy_loc_span_impl(&span);
+  }
+}
 
 /* Collect local spans manually without a parent, see
  * `ftr_push_child_spans_to_cur` to learn more. */
@@ -225,6 +1015,20 @@ ftr_coll_cfg ftr_create_def_coll_cfg(void);
  */
 ftr_coll_cfg ftr_set_max_spans_per_trace(ftr_coll_cfg cfg, size_t mspt);
 
+/*
+ * Keeps at most `n` bytes of spans per trace, 0 for no limit. The size of a
+ * span is estimated as for `ftr_set_queue_max_bytes`. Spans past the limit are
+ * dropped in the order they are reported, and counted in `spans_dropped`.
+ *
+ * # Note
+ *
+ * As with `ftr_set_max_spans_per_trace`, the root span is always kept, so the
+ * spans kept may exceed the limit. The limit applies once a trace is reported,
+ * so it bounds what the reporter and the queue hold, not the memory used while
+ * the trace is being recorded.
+ */
+ftr_coll_cfg ftr_set_max_bytes_per_trace(ftr_coll_cfg cfg, size_t n);
+
 /*
  * The time duration between two batch reports.
  *
@@ -237,12 +1041,237 @@ ftr_coll_cfg ftr_set_max_spans_per_trace(ftr_coll_cfg cfg, size_t mspt);
  */
 ftr_coll_cfg ftr_set_report_interval(ftr_coll_cfg cfg, uint64_t ri);
 
+/*
+ * Head sampling, applied by `ftr_create_root_span` to traces whose parent
+ * context is sampled. A trace that is not kept gets an unsampled root span, see
+ * `FTR_SPAN_CTX`. The decision takes no lock.
+ *
+ * By default all traces are kept.
+ */
+
+/*
+ * Keep the given ratio of traces, in [0, 1].
+ *
+ * The decision is made on the trace id, so processes configured with the same
+ * ratio keep the same traces.
+ */
+ftr_coll_cfg ftr_set_sample_ratio(ftr_coll_cfg cfg, double ratio);
+
+/*
+ * Keep at most `per_sec` traces per second, with bursts of up to `burst`
+ * traces. Applied to the traces kept by the ratio. 0 means no limit.
+ */
+ftr_coll_cfg ftr_set_sample_rate_limit(ftr_coll_cfg cfg, double per_sec,
+                                       uint64_t burst);
+
+/*
+ * Same as `ftr_set_sample_ratio`, for root spans named `name` only.
+ *
+ * Root spans of a name given here follow their own ratio and rate limit in
+ * place of the ones above. Up to 8 names can be given, further ones are
+ * ignored.
+ */
+ftr_coll_cfg ftr_set_root_sample_ratio(ftr_coll_cfg cfg, const char *name,
+                                       double ratio);
+
+/* Same as `ftr_set_sample_rate_limit`, for root spans named `name` only. */
+ftr_coll_cfg ftr_set_root_sample_rate_limit(ftr_coll_cfg cfg, const char *name,
+                                            double per_sec, uint64_t burst);
+
+/*
+ * Tail sampling, applied by the collector to finished traces before they are
+ * handed to the reporter. Once any of the settings below is given, a trace is
+ * reported only if it matches at least one of them, and the others are dropped
+ * before being converted or serialized.
+ *
+ * Traces are judged on the spans of the same report, which always hold whole
+ * traces, so no extra buffering is needed.
+ */
+
+/* Keep the traces whose root span lasts at least `ns` nanoseconds. */
+ftr_coll_cfg ftr_set_tail_min_duration(ftr_coll_cfg cfg, uint64_t ns);
+
+/*
+ * Keep the traces whose root span lasts at least the given percentile, in
+ * (0, 1), of the recent root spans with the same name, e.g. 0.99 for the
+ * slowest 1%.
+ *
+ * The percentiles are estimated from a histogram per root span name, and are
+ * only applied once a name has been seen 100 times: until then, all its
+ * traces are kept.
+ */
+ftr_coll_cfg ftr_set_tail_percentile(ftr_coll_cfg cfg, double percentile);
+
+/*
+ * Keep the traces with a span carrying the property `key`, e.g. "error",
+ * unless its value is "false" or "0".
+ */
+ftr_coll_cfg ftr_set_tail_error_prop(ftr_coll_cfg cfg, const char *key);
+
+/*
+ * Bounds the spans buffered on their way to the reporter. fastrace hands
+ * finished traces to the reporter on its collector thread and keeps buffering
+ * new spans while it is busy, without a limit. The reporter runs on a thread
+ * of its own instead, fed by a queue. Once a cap below is set, the queue holds
+ * at most that many spans, and `ftr_set_queue_overflow` decides what happens
+ * when it is full.
+ *
+ * Spans are queued after tail sampling, and dropped ones are counted in
+ * `ftr_collector_stats`.
+ */
+
+/* Queue at most `n` spans, 0 for no limit. */
+ftr_coll_cfg ftr_set_queue_max_spans(ftr_coll_cfg cfg, size_t n);
+
+/*
+ * Queue at most `n` bytes of spans, 0 for no limit. The size of a span is
+ * estimated from its record and the lengths of its name, properties and
+ * events.
+ */
+ftr_coll_cfg ftr_set_queue_max_bytes(ftr_coll_cfg cfg, size_t n);
+
+/*
+ * Sets what happens to new spans when the queue is full, by default
+ * `FTR_OVERFLOW_DROP_NEWEST`. With `FTR_OVERFLOW_BLOCK`, the collector thread
+ * waits for the reporter, and spans buffer up in fastrace again. Spans
+ * collected by a flush are queued past the cap instead, as the reporter thread
+ * waits for them.
+ */
+ftr_coll_cfg ftr_set_queue_overflow(ftr_coll_cfg cfg, ftr_overflow policy);
+
+/*
+ * Returns the counters of the collector, which are cumulative over the
+ * lifetime of the process, except for the queue ones.
+ *
+ * `spans_created` is kept per thread, so counting costs each span a
+ * thread-local increment, and reading it a lock shared with thread creation
+ * and exit. The others are updated by the collector once per batch.
+ */
+ftr_collector_stats ftr_get_collector_stats(void);
+
+/*
+ * Returns the clock reading the start and end of every span, and
+ * `ftr_span_elapsed`. It is chosen by fastrace once per process: the TSC where
+ * the kernel itself trusts it as its clock source, which is the case on most
+ * x86-64 servers, and the coarse monotonic clock otherwise. Reading the TSC
+ * costs a few nanoseconds and does not enter the kernel.
+ */
+ftr_clock_source ftr_get_clock_source(void);
+
 /* Sets console reporter for the current application, usually used for
  * debugging. */
 void ftr_set_cons_rptr(void);
 
+/*
+ * Sets a reporter appending span records to a ring of `files` memory-mapped
+ * files of `file_bytes` bytes each in `dir`, for capturing at full rate
+ * without a collector. Once the ring is full, the oldest records are
+ * overwritten. A new ring picks up after the newest file left in `dir` by a
+ * previous run.
+ *
+ * The files are in a compact binary format described in `src/ring.rs`, and
+ * `tools/ring2otlp.py` converts them to OTLP JSON. Returns false if the
+ * files could not be set up.
+ */
+bool ftr_set_ring_rptr(const char *dir, size_t file_bytes, size_t files,
+                       ftr_coll_cfg cfg);
+
+/*
+ * Sets a reporter handing every batch of finished spans to `report`, with
+ * `user_data`, to export them with a transport of the application. The spans
+ * are passed as views of the records of the collector, without copying them:
+ * they, and the strings and arrays they point to, are only valid until
+ * `report` returns. The views are laid out in arrays reused across batches,
+ * so reporting a batch does not allocate once they have grown to fit.
+ *
+ * `report` is called on the reporter thread, see `ftr_set_queue_max_spans`,
+ * one batch at a time. `user_data` must stay valid until another reporter is
+ * set.
+ */
+void ftr_set_custom_rptr(ftr_report_fn report, void *user_data,
+                         ftr_coll_cfg cfg);
+
+/*
+ * Same as `ftr_set_custom_rptr`, passing each batch as columns instead, for
+ * reporters processing one field of all spans at a time, e.g. to encode or
+ * compress it. Building the columns costs a hash lookup per string to
+ * deduplicate them; the arrays are reused across batches.
+ */
+void ftr_set_columnar_rptr(ftr_report_columns_fn report, void *user_data,
+                           ftr_coll_cfg cfg);
+
 ftr_otlp_exp_cfg ftr_create_def_otlp_exp_cfg(void);
 
+/*
+ * The exporters share one Tokio runtime, built from the configuration of the
+ * first `ftr_create_otel_rptr` call, which sends the requests of both gRPC and
+ * HTTP. The runtime settings of later calls are ignored.
+ *
+ * By default the runtime has a pool of 2 threads.
+ */
+
+/* Run the exporters on a pool of `n` threads. */
+ftr_otlp_exp_cfg ftr_set_otlp_rt_workers(ftr_otlp_exp_cfg cfg, size_t n);
+
+/* Pin the exporter threads to the given CPUs, below 256. Linux only. If none
+ * of them can be used, e.g. all offline, the threads run unpinned and are
+ * counted in `ftr_collector_stats.exporter_threads_unpinned`. */
+ftr_otlp_exp_cfg ftr_set_otlp_rt_cpus(ftr_otlp_exp_cfg cfg,
+                                      const uint32_t *cpus, size_t n);
+
+/* Run the exporters on a single thread, e.g. for small sidecars. */
+ftr_otlp_exp_cfg ftr_set_otlp_rt_cur_thread(ftr_otlp_exp_cfg cfg);
+
+/*
+ * Run the exporters on a single thread of the application.
+ *
+ * When the runtime is built, `spawn` is called once and must arrange for
+ * `run(arg)` to be called on a thread of its own, e.g. a dedicated thread of
+ * the application's executor. `run` does not return. CPU pinning is left to
+ * the application.
+ */
+ftr_otlp_exp_cfg ftr_set_otlp_rt_spawner(ftr_otlp_exp_cfg cfg,
+                                         ftr_rt_spawn_fn spawn,
+                                         void *user_data);
+
+/*
+ * Export over gRPC (default) or over HTTP with protobuf payloads.
+ *
+ * Unless `ftr_set_otlp_endpoint` is called, HTTP exports go to
+ * `OTEL_EXPORTER_OTLP_ENDPOINT`, by default http://127.0.0.1:4318, followed by
+ * `/v1/traces`, and gRPC exports to `OTEL_EXPORTER_OTLP_ENDPOINT`, by default
+ * http://127.0.0.1:4317. Either way, the connections are kept across exports.
+ */
+ftr_otlp_exp_cfg ftr_set_otlp_protocol(ftr_otlp_exp_cfg cfg,
+                                       ftr_otlp_protocol protocol);
+
+/* Export to `endpoint`, the full URL of the traces for HTTP. */
+ftr_otlp_exp_cfg ftr_set_otlp_endpoint(ftr_otlp_exp_cfg cfg,
+                                       const char *endpoint);
+
+/* Compress the exports, sent with the matching `grpc-encoding` or
+ * `Content-Encoding`. */
+ftr_otlp_exp_cfg ftr_set_otlp_compression(ftr_otlp_exp_cfg cfg,
+                                          ftr_otlp_compression compression);
+
+/*
+ * Send the header `key: val` with every export, e.g. for authentication,
+ * replacing any header of the same name given before. With gRPC, headers are
+ * sent as metadata, and keys are lowercased.
+ */
+ftr_otlp_exp_cfg ftr_add_otlp_header(ftr_otlp_exp_cfg cfg, const char *key,
+                                     const char *val);
+
+/* Give up on an export after `ms` milliseconds, 10 seconds by default. */
+ftr_otlp_exp_cfg ftr_set_otlp_timeout(ftr_otlp_exp_cfg cfg, uint64_t ms);
+
+/*
+ * Split the batches handed to the reporter, so that each export holds at most
+ * about `n` bytes of spans before encoding, 0 for no limit. The size of a span
+ * is estimated as for `ftr_set_queue_max_bytes`.
+ */
+ftr_otlp_exp_cfg ftr_set_otlp_max_batch_bytes(ftr_otlp_exp_cfg cfg, size_t n);
+
 /*
  * Create an `ftr_otel_rptr` to export trace records to remote agents that
  * OpenTelemetry supports, which includes Jaeger, Datadog, Zipkin, and
@@ -262,10 +1291,43 @@ void ftr_set_otel_rptr(ftr_otel_rptr rptr, ftr_coll_cfg cfg);
  *
  * It will create a new thread in the current thread to do this,
  * and it will block the current thread until the new thread finishes flushing
- * and exits.
+ * and exits. It then waits until the reporter thread has reported the queued
+ * spans. Called from a reporter, e.g. one set by `ftr_set_custom_rptr`, it
+ * does not wait for itself: the spans are reported once the reporter returns,
+ * and `ftr_flush_timeout` counts them as `pending`.
  */
 void ftr_flush(void);
 
+/*
+ * Queues a flush and returns at once. Flushes are served by the reporter
+ * thread between batches, and requests queued meanwhile are served together.
+ * `cb`, if not NULL, is called with `user_data` on that thread once the flush
+ * is done.
+ *
+ * A flush reports the spans it collects unless its deadline has passed by
+ * then: `FTR_FLUSH_ASYNC_TIMEOUT_MS` after the request, or the timeout of
+ * `ftr_flush_timeout`. Spans left queued are counted as `pending`, and
+ * reported with the next batch. A flush waits for the batch being reported
+ * when it is queued, which the timeout of the exporter bounds.
+ *
+ * # Note
+ *
+ * It takes a lock and may allocate, so it is not async-signal-safe: call it
+ * from a thread that waits for the signal, e.g. with `sigwait`.
+ */
+void ftr_flush_async(ftr_flush_cb cb, void *user_data);
+
+/* Deadline of `ftr_flush_async` for reporting the spans it collects. */
+#define FTR_FLUSH_ASYNC_TIMEOUT_MS 10000
+
+/*
+ * Queues a flush like `ftr_flush_async` and waits for it up to `ms`
+ * milliseconds. Returns whether it completed, in which case `stats`, if not
+ * NULL, is filled in. A flush that timed out is withdrawn if the reporter
+ * thread has not started it yet, or else completes in the background.
+ */
+bool ftr_flush_timeout(uint64_t ms, ftr_flush_stats *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -273,6 +1335,11 @@ void ftr_flush(void);
 #ifdef __cplusplus
 namespace fastrace {
 
+// Selects the overloads taking any integer type other than bool.
+template <typename T>
+using EnableIfInteger = typename std::enable_if<
+    std::is_integral<T>::value && !std::is_same<T, bool>::value, int>::type;
+
 // C++ wrapper classes
 
 /**
@@ -295,10 +1362,59 @@ class SpanContext {
   /** @brief Sets the sampling flag for this SpanContext. */
   void setSampled(bool sampled);
 
+  /**
+   * @brief Writes the W3C `traceparent` header value of this context to
+   * `buf`, see `ftr_span_ctx_encode_w3c`. Returns its length, or 0 if `len` is
+   * too short.
+   */
+  size_t toTraceparent(char *buf, size_t len) const;
+
+  /** @brief Returns the W3C `traceparent` header value of this context. */
+  std::string toTraceparent() const;
+
+  /**
+   * @brief Parses a W3C `traceparent` header value into `ctx`. Returns false,
+   * leaving `ctx` untouched, if it is invalid.
+   */
+  static bool fromTraceparent(const char *value, size_t len,
+                              SpanContext &ctx);
+
+  /**
+   * @brief Writes the binary encoding of this context to `buf`, see
+   * `ftr_span_ctx_encode_bin`. Returns its length, or 0 if `len` is too short.
+   */
+  size_t serializeBinary(uint8_t *buf, size_t len) const;
+
+  /**
+   * @brief Parses the binary encoding at `buf` into `ctx`. Returns false,
+   * leaving `ctx` untouched, if it is invalid.
+   */
+  static bool deserializeBinary(const uint8_t *buf, size_t len,
+                                SpanContext &ctx);
+
  private:
   ftr_span_ctx ctx_;
 };
 
+/**
+ * @brief A span name registered once with the tracing system.
+ *
+ * Spans created from a SpanName skip the per-call length and UTF-8 checks of
+ * `const char *` names. Construct it once per call site, e.g. as a
+ * function-local static.
+ */
+class SpanName {
+ public:
+  /** @brief Registers the given name. */
+  explicit SpanName(const char *name);
+
+  /** @brief Returns the raw ftr_name_id representation. */
+  ftr_name_id raw() const;
+
+ private:
+  ftr_name_id name_;
+};
+
 /**
  * @brief Represents a span in the tracing system.
  *
@@ -317,6 +1433,40 @@ class Span {
    * span as parent. */
   explicit Span(const char *name);
 
+  /** @brief Creates a root span with a registered name and parent context. */
+  Span(const SpanName &name, const SpanContext &parent);
+
+  /** @brief Creates a child span with a registered name and parent span. */
+  Span(const SpanName &name, const Span &parent);
+
+  /** @brief Creates a child span with a registered name, using the current
+   * local span as parent. */
+  explicit Span(const SpanName &name);
+
+  /**
+   * @brief Creates `n` child spans of `parent` into `out`, the i-th one named
+   * `names[i]`, with a single call into the library. The spans previously in
+   * `out` are destroyed first; `parent` must not be one of them.
+   */
+  static void enterBatch(const char *const *names, size_t n,
+                         const Span &parent, Span *out);
+
+  /** @brief Same as enterBatch(), with registered names. */
+  static void enterBatch(const SpanName *names, size_t n, const Span &parent,
+                         Span *out);
+
+  /**
+   * @brief Records a finished child span of `parent` that ran from `startNs`
+   * to `endNs`, in nanoseconds since the Unix epoch. See
+   * `ftr_create_child_spans_at`.
+   */
+  static void fromTimestamps(const char *name, const Span &parent,
+                             uint64_t startNs, uint64_t endNs);
+
+  /** @brief Records `n` finished child spans of `parent` at once. */
+  static void fromTimestamps(const Span &parent, const ftr_timed_span *spans,
+                             size_t n);
+
   /** @brief Move constructor */
   Span(Span &&other) noexcept;
 
@@ -342,15 +1492,39 @@ class Span {
   /** @brief Adds a single key-value property to the span. */
   void addProperty(const char *key, const char *value);
 
+  /** @brief Adds a property with an integer value, formatted only if the span
+   * is recorded. */
+  template <typename T, EnableIfInteger<T> = 0>
+  void addProperty(const char *key, T value) {
+    if (std::is_signed<T>::value) {
+      ftr_span_with_prop_i64(&span_, key, static_cast<int64_t>(value));
+    } else {
+      ftr_span_with_prop_u64(&span_, key, static_cast<uint64_t>(value));
+    }
+  }
+
+  /** @brief Adds a property with a floating-point value. */
+  void addProperty(const char *key, double value);
+
+  /** @brief Adds a property with a boolean value. */
+  void addProperty(const char *key, bool value);
+
   /** @brief Adds multiple key-value properties to the span. */
   void addProperties(
       const std::vector<std::pair<const char *, const char *>> &properties);
 
+  /** @brief Adds properties with explicit lengths to the span, borrowing the
+   * ones flagged as static. */
+  void addProperties(const ftr_prop *properties, size_t n);
+
   /** @brief Adds an event with the given name and properties to the span. */
   void addEvent(
       const char *name,
       const std::vector<std::pair<const char *, const char *>> &properties);
 
+  /** @brief Adds an event with properties of explicit lengths to the span. */
+  void addEvent(const char *name, const ftr_prop *properties, size_t n);
+
   /** @brief Returns a pointer to the raw ftr_span representation. */
   ftr_span *raw();
 
@@ -358,7 +1532,8 @@ class Span {
   const ftr_span *raw() const;
 
   /**
-   * @brief Returns the elapsed time since the span was created in nanoseconds.
+   * @brief Returns the elapsed time since the span was created in nanoseconds,
+   * from the clock of clockSource().
    * @return Elapsed time in nanoseconds, or 0 if the span is not active.
    */
   uint64_t elapsed() const;
@@ -396,6 +1571,9 @@ class LocalSpan {
   /** @brief Creates a new local span with the given name. */
   explicit LocalSpan(const char *name);
 
+  /** @brief Creates a new local span with a registered name. */
+  explicit LocalSpan(const SpanName &name);
+
   /** @brief Copy constructor (deleted to ensure unique ownership) */
   LocalSpan(const LocalSpan &) = delete;
 
@@ -415,30 +1593,217 @@ class LocalSpan {
    */
   void addProperty(const char *key, const char *value);
 
+  /** @brief Adds a property with an integer value to the current local parent
+   * span. */
+  template <typename T, EnableIfInteger<T> = 0>
+  void addProperty(const char *key, T value) {
+    if (std::is_signed<T>::value) {
+      ftr_loc_span_add_prop_i64(key, static_cast<int64_t>(value));
+    } else {
+      ftr_loc_span_add_prop_u64(key, static_cast<uint64_t>(value));
+    }
+  }
+
+  /** @brief Adds a property with a floating-point value to the current local
+   * parent span. */
+  void addProperty(const char *key, double value);
+
+  /** @brief Adds a property with a boolean value to the current local parent
+   * span. */
+  void addProperty(const char *key, bool value);
+
   /** @brief Adds multiple key-value properties to the current local parent
    * span. */
   void addProperties(
       const std::vector<std::pair<const char *, const char *>> &properties);
 
+  /** @brief Adds properties with explicit lengths to the current local parent
+   * span. */
+  void addProperties(const ftr_prop *properties, size_t n);
+
   /** @brief Adds a single key-value property to the local span and returns the
    * modified local span. */
   void withProperty(const char *key, const char *value);
 
+  /** @brief Adds a property with an integer value to the local span. */
+  template <typename T, EnableIfInteger<T> = 0>
+  void withProperty(const char *key, T value) {
+    if (std::is_signed<T>::value) {
+      ftr_loc_span_with_prop_i64(&span_, key, static_cast<int64_t>(value));
+    } else {
+      ftr_loc_span_with_prop_u64(&span_, key, static_cast<uint64_t>(value));
+    }
+  }
+
+  /** @brief Adds a property with a floating-point value to the local span. */
+  void withProperty(const char *key, double value);
+
+  /** @brief Adds a property with a boolean value to the local span. */
+  void withProperty(const char *key, bool value);
+
   /** @brief Adds multiple key-value properties to the local span and returns
    * the modified local span. */
   void withProperties(
       const std::vector<std::pair<const char *, const char *>> &properties);
 
+  /** @brief Adds properties with explicit lengths to the local span. */
+  void withProperties(const ftr_prop *properties, size_t n);
+
   /** @brief Adds an event with the given name and properties to the current
    * local parent span. */
   void addEvent(
       const char *name,
       const std::vector<std::pair<const char *, const char *>> &properties);
 
+  /** @brief Adds an event with properties of explicit lengths to the current
+   * local parent span. */
+  void addEvent(const char *name, const ftr_prop *properties, size_t n);
+
  private:
   ftr_loc_span span_;
 };
 
+#ifdef FTR_HAS_COROUTINES
+template <typename Awaitable>
+class LocalParentAwaiter;
+
+/**
+ * @brief Keeps a span as the local parent of a C++20 coroutine, across
+ * suspensions.
+ *
+ * A LocalParentGuard only holds on the thread that set it, while a coroutine
+ * may resume on another thread. Declare a CoroutineLocalParent in the
+ * coroutine body instead, and await through `wrap()`: the local parent is
+ * unset before the coroutine suspends, and set again on the resuming thread
+ * before it continues. The local spans recorded in between are collected into
+ * the span each time the local parent is unset.
+ *
+ * A LocalSpan must not be held across a `co_await`, nor any `co_await` made
+ * without `wrap()` while the local parent is set.
+ */
+class CoroutineLocalParent {
+ public:
+  /** @brief Sets the given span as the local parent until destroyed. */
+  explicit CoroutineLocalParent(const Span &span) : span_(&span) { resume(); }
+
+  CoroutineLocalParent(const CoroutineLocalParent &) = delete;
+  CoroutineLocalParent &operator=(const CoroutineLocalParent &) = delete;
+
+  /** @brief Unsets the local parent. */
+  ~CoroutineLocalParent() { suspend(); }
+
+  /** @brief Unsets the local parent, if set. */
+  void suspend() {
+    if (set_) {
+      set_ = false;
+      ftr_destroy_loc_par_guar(guard_);
+    }
+  }
+
+  /** @brief Sets the local parent on the current thread, if unset. */
+  void resume() {
+    if (!set_) {
+      guard_ = ftr_set_loc_par_to_span(span_->raw());
+      set_ = true;
+    }
+  }
+
+  /**
+   * @brief Returns an awaitable behaving like `awaitable`, with the local
+   * parent unset while the coroutine is suspended on it.
+   */
+  template <typename Awaitable>
+  LocalParentAwaiter<Awaitable> wrap(Awaitable &&awaitable);
+
+ private:
+  const Span *span_;
+  ftr_loc_par_guar guard_;
+  bool set_ = false;
+};
+
+namespace detail {
+
+template <typename T, typename = void>
+struct HasMemberCoAwait : std::false_type {};
+
+template <typename T>
+struct HasMemberCoAwait<
+    T, std::void_t<decltype(std::declval<T>().operator co_await())>>
+    : std::true_type {};
+
+template <typename T, typename = void>
+struct HasFreeCoAwait : std::false_type {};
+
+template <typename T>
+struct HasFreeCoAwait<
+    T, std::void_t<decltype(operator co_await(std::declval<T>()))>>
+    : std::true_type {};
+
+// Returns the awaiter `co_await` would use for `awaitable`.
+template <typename T>
+decltype(auto) getAwaiter(T &&awaitable) {
+  if constexpr (HasMemberCoAwait<T>::value) {
+    return std::forward<T>(awaitable).operator co_await();
+  } else if constexpr (HasFreeCoAwait<T>::value) {
+    return operator co_await(std::forward<T>(awaitable));
+  } else {
+    return std::forward<T>(awaitable);
+  }
+}
+
+}  // namespace detail
+
+/**
+ * @brief Awaitable returned by `CoroutineLocalParent::wrap()`. It is meant to
+ * be awaited right away, and can be neither copied nor moved.
+ */
+template <typename Awaitable>
+class LocalParentAwaiter {
+ public:
+  LocalParentAwaiter(CoroutineLocalParent &parent, Awaitable &&awaitable)
+      : parent_(parent),
+        awaitable_(std::forward<Awaitable>(awaitable)),
+        awaiter_(detail::getAwaiter(std::forward<Awaitable>(awaitable_))) {}
+
+  LocalParentAwaiter(const LocalParentAwaiter &) = delete;
+  LocalParentAwaiter &operator=(const LocalParentAwaiter &) = delete;
+
+  bool await_ready() { return awaiter_.await_ready(); }
+
+  template <typename Promise>
+  decltype(auto) await_suspend(std::coroutine_handle<Promise> handle) {
+    // Once handed over, the coroutine may resume on another thread before
+    // `await_suspend` returns, so the local parent is unset beforehand.
+    parent_.suspend();
+    try {
+      return awaiter_.await_suspend(handle);
+    } catch (...) {
+      parent_.resume();
+      throw;
+    }
+  }
+
+  decltype(auto) await_resume() {
+    parent_.resume();
+    return awaiter_.await_resume();
+  }
+
+ private:
+  using Awaiter = decltype(detail::getAwaiter(std::declval<Awaitable &&>()));
+
+  CoroutineLocalParent &parent_;
+  Awaitable awaitable_;
+  Awaiter awaiter_;
+};
+
+template <typename Awaitable>
+LocalParentAwaiter<Awaitable> CoroutineLocalParent::wrap(
+    Awaitable &&awaitable) {
+  return LocalParentAwaiter<Awaitable>(*this,
+                                       std::forward<Awaitable>(awaitable));
+}
+#endif
+
 /**
  * @brief Configuration for the global collector.
  *
@@ -452,9 +1817,50 @@ class CollectorConfig {
   /** @brief Sets the maximum number of spans per trace. */
   void setMaxSpansPerTrace(size_t max);
 
+  /** @brief Sets the maximum estimated bytes of spans kept per trace. */
+  void setMaxBytesPerTrace(size_t n);
+
   /** @brief Sets the interval between batch reports in milliseconds. */
   void setReportInterval(uint64_t interval);
 
+  /** @brief Keeps the given ratio of traces, decided on the trace id. */
+  void setSampleRatio(double ratio);
+
+  /** @brief Keeps at most perSecond traces per second, with bursts of up to
+   * burst traces. */
+  void setSampleRateLimit(double perSecond, uint64_t burst);
+
+  /** @brief Keeps the given ratio of traces with the named root span, in place
+   * of the global ratio. */
+  void setRootSampleRatio(const char *name, double ratio);
+
+  /** @brief Limits the rate of traces with the named root span, in place of
+   * the global limit. */
+  void setRootSampleRateLimit(const char *name, double perSecond,
+                              uint64_t burst);
+
+  /** @brief Reports only the traces whose root span lasts at least the given
+   * nanoseconds, or that match another tail sampling setting. */
+  void setTailMinDuration(uint64_t ns);
+
+  /** @brief Reports only the traces whose root span lasts at least the given
+   * percentile of its name, or that match another tail sampling setting. */
+  void setTailPercentile(double percentile);
+
+  /** @brief Reports only the traces with a span carrying the given property,
+   * or that match another tail sampling setting. */
+  void setTailErrorProperty(const char *key);
+
+  /** @brief Caps the number of spans queued for the reporter, 0 for no cap. */
+  void setQueueMaxSpans(size_t n);
+
+  /** @brief Caps the estimated bytes of spans queued for the reporter, 0 for
+   * no cap. */
+  void setQueueMaxBytes(size_t n);
+
+  /** @brief Sets what happens to new spans when the queue is full. */
+  void setQueueOverflow(ftr_overflow policy);
+
   /** @brief Returns the raw ftr_coll_cfg representation. */
   ftr_coll_cfg raw() const;
 
@@ -470,6 +1876,38 @@ class OTLPExporterConfig {
   /** @brief Creates a default OTLP exporter configuration. */
   OTLPExporterConfig();
 
+  /** @brief Runs the exporters on a pool of the given number of threads. */
+  void setWorkerThreads(size_t n);
+
+  /** @brief Pins the exporter threads to the given CPUs. */
+  void setCpuAffinity(const std::vector<uint32_t> &cpus);
+
+  /** @brief Runs the exporters on a single thread. */
+  void setCurrentThread();
+
+  /** @brief Runs the exporters on a single thread obtained from the
+   * application, see `ftr_set_otlp_rt_spawner`. */
+  void setSpawner(ftr_rt_spawn_fn spawn, void *userData);
+
+  /** @brief Exports over gRPC (default) or HTTP with protobuf payloads. */
+  void setProtocol(ftr_otlp_protocol protocol);
+
+  /** @brief Exports to the given endpoint, the full URL of the traces for
+   * HTTP. */
+  void setEndpoint(const char *endpoint);
+
+  /** @brief Compresses the exports with gzip or zstd. */
+  void setCompression(ftr_otlp_compression compression);
+
+  /** @brief Sends the given header with every export. */
+  void addHeader(const char *key, const char *val);
+
+  /** @brief Gives up on an export after the given milliseconds. */
+  void setTimeout(uint64_t ms);
+
+  /** @brief Limits each export to about the given bytes of spans. */
+  void setMaxBatchBytes(size_t n);
+
   /** @brief Returns the raw ftr_otlp_exp_cfg representation. */
   ftr_otlp_exp_cfg raw() const;
 
@@ -514,10 +1952,104 @@ void setOpenTelemetryReporter(OpenTelemetryReporter &reporter,
 /** @brief Sets the console reporter for debugging purposes. */
 void setConsoleReporter();
 
+/** @brief Sets a reporter writing to a ring of memory-mapped files, see
+ * `ftr_set_ring_rptr`. Returns false if the files could not be set up. */
+bool setRingFileReporter(const char *dir, size_t fileBytes, size_t files,
+                         const CollectorConfig &config);
+
+/**
+ * @brief Receives the finished spans, see `ftr_set_custom_rptr`. Set with
+ * setReporter().
+ */
+class Reporter {
+ public:
+  virtual ~Reporter() = default;
+
+  /** @brief Called with each batch of spans, which are only valid during the
+   * call. */
+  virtual void report(const ftr_span_view *spans, size_t n) = 0;
+};
+
+/** @brief Sets a reporter implemented by the application. It is destroyed
+ * once another reporter is set. */
+void setReporter(std::unique_ptr<Reporter> reporter,
+                 const CollectorConfig &config);
+
+/**
+ * @brief Receives the finished spans as columns, see `ftr_set_columnar_rptr`.
+ * Set with setReporter().
+ */
+class ColumnarReporter {
+ public:
+  virtual ~ColumnarReporter() = default;
+
+  /** @brief Called with each batch of spans, which is only valid during the
+   * call. */
+  virtual void report(const ftr_span_columns &batch) = 0;
+};
+
+/** @brief Sets a columnar reporter implemented by the application. It is
+ * destroyed once another reporter is set. */
+void setReporter(std::unique_ptr<ColumnarReporter> reporter,
+                 const CollectorConfig &config);
+
 /** @brief Flushes all pending span records to the reporter immediately. */
 void flush();
 
+/** @brief Returns the counters of the collector. */
+ftr_collector_stats collectorStats();
+
+/** @brief Returns the clock timestamping the spans, see
+ * `ftr_get_clock_source`. */
+ftr_clock_source clockSource();
+
+/**
+ * @brief Queues a flush and returns at once. `done`, if set, is called on the
+ * reporter thread once the flush is done, see `ftr_flush_async`.
+ */
+void flushAsync(std::function<void(const ftr_flush_stats &)> done = nullptr);
+
+/**
+ * @brief Flushes, waiting up to `timeout_ms` milliseconds. Returns whether
+ * the flush completed, in which case `stats`, if not null, is filled in.
+ */
+bool flush(uint64_t timeout_ms, ftr_flush_stats *stats = nullptr);
+
 }  // namespace fastrace
+
+/*
+ * Instrumentation macros, each entering a local span until the end of the
+ * enclosing scope. The name is registered as a `fastrace::SpanName` once per
+ * call site, in a function-local static, so later calls do no string handling.
+ *
+ * Defining `FASTRACE_DISABLE` before including this header turns them into
+ * nothing, without evaluating the name.
+ */
+#ifdef FASTRACE_DISABLE
+#define FASTRACE_SCOPE(name) static_cast<void>(0)
+#else
+#define FTR_CONCAT_(a, b) a##b
+#define FTR_CONCAT(a, b) FTR_CONCAT_(a, b)
+
+/* Unique per expansion, so that several scopes may share a line, e.g. when
+ * expanded from another macro. */
+#ifdef __COUNTER__
+#define FTR_UNIQUE_ID __COUNTER__
+#else
+#define FTR_UNIQUE_ID __LINE__
+#endif
+
+#define FTR_SCOPE_(name, id)                                          \
+  static const ::fastrace::SpanName FTR_CONCAT(ftr_name_, id)(name); \
+  ::fastrace::LocalSpan FTR_CONCAT(ftr_scope_, id)(FTR_CONCAT(ftr_name_, id))
+
+/* Enters a local span named `name`, a string literal or any `const char *`
+ * valid when the call site is first reached. */
+#define FASTRACE_SCOPE(name) FTR_SCOPE_(name, FTR_UNIQUE_ID)
+#endif
+
+/* Enters a local span named after the enclosing function. */
+#define FASTRACE_FUNC_SPAN() FASTRACE_SCOPE(__func__)
 #endif
 
 #endif /* __LIBFASTRACE_H */
@@ -0,0 +1,82 @@
+// Copyright 2023 Wenbo Zhang. Licensed under Apache-2.0.
+
+//! Limit on the estimated bytes of each trace, configured through
+//! `ftr_coll_cfg`. It complements `max_spans_per_trace` of fastrace, which
+//! counts spans whatever their size.
+
+use std::collections::{HashMap, HashSet};
+
+use fastrace::collector::{Reporter, SpanRecord};
+
+use crate::{queue::span_bytes, stats};
+
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+pub struct BudgetCfg {
+    /// Estimated bytes of spans kept per trace at most, 0 for no limit.
+    max_trace_bytes: u64,
+}
+
+impl BudgetCfg {
+    pub fn set_max_trace_bytes(&mut self, n: usize) {
+        self.max_trace_bytes = n as u64;
+    }
+
+    pub fn is_enabled(&self) -> bool {
+        self.max_trace_bytes > 0
+    }
+}
+
+/// Drops the spans of a trace past its budget, in the order they are handed
+/// over. Like fastrace, the root span of a trace is always kept, and counts
+/// against its budget.
+pub struct TraceBudget<R> {
+    inner: R,
+    max_bytes: usize,
+    /// Bytes kept per trace of the current batch, reused across batches.
+    used: HashMap<u128, usize>,
+}
+
+impl<R: Reporter> TraceBudget<R> {
+    pub fn new(inner: R, cfg: BudgetCfg) -> Self {
+        Self {
+            inner,
+            max_bytes: cfg.max_trace_bytes as usize,
+            used: HashMap::new(),
+        }
+    }
+}
+
+impl<R: Reporter> Reporter for TraceBudget<R> {
+    fn report(&mut self, mut spans: Vec<SpanRecord>) {
+        // A root may have a remote parent, so it is told apart as in the tail
+        // sampler: its parent is not in the batch.
+        let ids: HashSet<(u128, u64)> = spans
+            .iter()
+            .map(|span| (span.trace_id.0, span.span_id.0))
+            .collect();
+        let is_root = |span: &SpanRecord| !ids.contains(&(span.trace_id.0, span.parent_id.0));
+
+        // Roots are charged first, so that their bytes always count.
+        for span in spans.iter().filter(|span| is_root(span)) {
+            *self.used.entry(span.trace_id.0).or_default() += span_bytes(span);
+        }
+
+        let total = spans.len();
+        spans.retain(|span| {
+            if is_root(span) {
+                return true;
+            }
+            let used = self.used.entry(span.trace_id.0).or_default();
+            let bytes = span_bytes(span);
+            let keep = *used + bytes <= self.max_bytes;
+            if keep {
+                *used += bytes;
+            }
+            keep
+        });
+        self.used.clear();
+        stats::add_dropped(total - spans.len());
+        self.inner.report(spans)
+    }
+}
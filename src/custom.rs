@@ -0,0 +1,394 @@
+// Copyright 2023 Wenbo Zhang. Licensed under Apache-2.0.
+
+//! Reporter handing the span records to a C callback, see
+//! `ftr_set_custom_rptr`.
+//!
+//! The callback is given views borrowing the strings of the records. The views
+//! are laid out in three arrays, reused from one batch to the next: spans,
+//! then events and properties, each span and event pointing to its slice of
+//! the arrays that follow.
+//!
+//! `ColumnarReporter` lays the batch out as columns instead, for consumers
+//! processing one field of every span at a time.
+
+use std::{
+    borrow::Cow,
+    collections::HashMap,
+    ffi::c_void,
+    hash::{Hash, Hasher},
+};
+
+use fastrace::collector::{Reporter, SpanRecord};
+
+/// Must match `ftr_report_fn`.
+pub type ReportFn = extern "C" fn(spans: *const SpanView, n: usize, user_data: *mut c_void);
+
+/// Frees the user data once the reporter is replaced.
+pub type DropFn = extern "C" fn(user_data: *mut c_void);
+
+/// Layout of `ftr_str` as declared in `libfastrace.h`.
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub struct Str {
+    ptr: *const u8,
+    len: usize,
+}
+
+impl Str {
+    pub fn new(s: &str) -> Self {
+        Self {
+            ptr: s.as_ptr(),
+            len: s.len(),
+        }
+    }
+}
+
+/// Layout of `ftr_kv` as declared in `libfastrace.h`.
+#[repr(C)]
+pub struct Kv {
+    key: Str,
+    val: Str,
+}
+
+/// Layout of `ftr_event_view` as declared in `libfastrace.h`.
+#[repr(C)]
+pub struct EventView {
+    name: Str,
+    timestamp_unix_ns: u64,
+    props: *const Kv,
+    n_props: usize,
+}
+
+/// Layout of `ftr_span_view` as declared in `libfastrace.h`.
+#[repr(C)]
+pub struct SpanView {
+    trace_id_high: u64,
+    trace_id_low: u64,
+    span_id: u64,
+    parent_id: u64,
+    begin_unix_ns: u64,
+    duration_ns: u64,
+    name: Str,
+    props: *const Kv,
+    n_props: usize,
+    events: *const EventView,
+    n_events: usize,
+}
+
+pub struct CustomReporter {
+    report: ReportFn,
+    drop: Option<DropFn>,
+    user_data: *mut c_void,
+    spans: Vec<SpanView>,
+    events: Vec<EventView>,
+    props: Vec<Kv>,
+}
+
+// The user data is only used by the thread owning the reporter, and the views
+// only during `report`.
+unsafe impl Send for CustomReporter {}
+
+impl CustomReporter {
+    pub fn new(report: ReportFn, drop: Option<DropFn>, user_data: *mut c_void) -> Self {
+        Self {
+            report,
+            drop,
+            user_data,
+            spans: Vec::new(),
+            events: Vec::new(),
+            props: Vec::new(),
+        }
+    }
+}
+
+fn props_of<'a>(
+    props: &'a [(Cow<'static, str>, Cow<'static, str>)],
+) -> impl Iterator<Item = Kv> + 'a {
+    props.iter().map(|(key, val)| Kv {
+        key: Str::new(key),
+        val: Str::new(val),
+    })
+}
+
+impl Reporter for CustomReporter {
+    fn report(&mut self, spans: Vec<SpanRecord>) {
+        if spans.is_empty() {
+            return;
+        }
+
+        // Reserved up front, so that the pointers taken while filling the
+        // arrays stay valid.
+        let (events, props) = spans.iter().fold((0, 0), |(events, props), span| {
+            (
+                events + span.events.len(),
+                props
+                    + span.properties.len()
+                    + span
+                        .events
+                        .iter()
+                        .map(|e| e.properties.len())
+                        .sum::<usize>(),
+            )
+        });
+        self.spans.clear();
+        self.events.clear();
+        self.props.clear();
+        self.spans.reserve(spans.len());
+        self.events.reserve(events);
+        self.props.reserve(props);
+
+        for span in &spans {
+            let span_props = self.props.as_ptr().wrapping_add(self.props.len());
+            self.props.extend(props_of(&span.properties));
+            let span_events = self.events.as_ptr().wrapping_add(self.events.len());
+            for event in &span.events {
+                let event_props = self.props.as_ptr().wrapping_add(self.props.len());
+                self.props.extend(props_of(&event.properties));
+                self.events.push(EventView {
+                    name: Str::new(&event.name),
+                    timestamp_unix_ns: event.timestamp_unix_ns,
+                    props: event_props,
+                    n_props: event.properties.len(),
+                });
+            }
+            self.spans.push(SpanView {
+                trace_id_high: (span.trace_id.0 >> 64) as u64,
+                trace_id_low: span.trace_id.0 as u64,
+                span_id: span.span_id.0,
+                parent_id: span.parent_id.0,
+                begin_unix_ns: span.begin_time_unix_ns,
+                duration_ns: span.duration_ns,
+                name: Str::new(&span.name),
+                props: span_props,
+                n_props: span.properties.len(),
+                events: span_events,
+                n_events: span.events.len(),
+            });
+        }
+
+        (self.report)(self.spans.as_ptr(), self.spans.len(), self.user_data);
+    }
+}
+
+impl Drop for CustomReporter {
+    fn drop(&mut self) {
+        if let Some(drop) = self.drop {
+            drop(self.user_data);
+        }
+    }
+}
+
+/// Must match `ftr_report_columns_fn`.
+pub type ReportColumnsFn = extern "C" fn(batch: *const Columns, user_data: *mut c_void);
+
+/// Layout of `ftr_span_columns` as declared in `libfastrace.h`.
+#[repr(C)]
+pub struct Columns {
+    n: usize,
+    trace_id_high: *const u64,
+    trace_id_low: *const u64,
+    span_id: *const u64,
+    parent_id: *const u64,
+    begin_unix_ns: *const u64,
+    duration_ns: *const u64,
+    name: *const u32,
+    props: *const u32,
+    prop_key: *const u32,
+    prop_val: *const u32,
+    events: *const u32,
+    event_name: *const u32,
+    event_timestamp_unix_ns: *const u64,
+    event_props: *const u32,
+    event_prop_key: *const u32,
+    event_prop_val: *const u32,
+    strings: *const Str,
+    n_strings: usize,
+}
+
+/// A string of the batch being reported, compared by content.
+struct Key(Str);
+
+impl Key {
+    fn as_bytes(&self) -> &[u8] {
+        unsafe { std::slice::from_raw_parts(self.0.ptr, self.0.len) }
+    }
+}
+
+impl PartialEq for Key {
+    fn eq(&self, other: &Self) -> bool {
+        self.as_bytes() == other.as_bytes()
+    }
+}
+
+impl Eq for Key {}
+
+impl Hash for Key {
+    fn hash<H: Hasher>(&self, state: &mut H) {
+        self.as_bytes().hash(state)
+    }
+}
+
+/// Reporter handing each batch to a C callback as columns, one array per
+/// field, with the strings deduplicated into a table.
+pub struct ColumnarReporter {
+    report: ReportColumnsFn,
+    drop: Option<DropFn>,
+    user_data: *mut c_void,
+    trace_id_high: Vec<u64>,
+    trace_id_low: Vec<u64>,
+    span_id: Vec<u64>,
+    parent_id: Vec<u64>,
+    begin_unix_ns: Vec<u64>,
+    duration_ns: Vec<u64>,
+    name: Vec<u32>,
+    props: Vec<u32>,
+    prop_key: Vec<u32>,
+    prop_val: Vec<u32>,
+    events: Vec<u32>,
+    event_name: Vec<u32>,
+    event_timestamp_unix_ns: Vec<u64>,
+    event_props: Vec<u32>,
+    event_prop_key: Vec<u32>,
+    event_prop_val: Vec<u32>,
+    strings: Vec<Str>,
+    /// Index of each string in `strings`. Emptied before the batch is dropped.
+    index: HashMap<Key, u32>,
+}
+
+// Same as `CustomReporter`.
+unsafe impl Send for ColumnarReporter {}
+
+impl ColumnarReporter {
+    pub fn new(report: ReportColumnsFn, drop: Option<DropFn>, user_data: *mut c_void) -> Self {
+        Self {
+            report,
+            drop,
+            user_data,
+            trace_id_high: Vec::new(),
+            trace_id_low: Vec::new(),
+            span_id: Vec::new(),
+            parent_id: Vec::new(),
+            begin_unix_ns: Vec::new(),
+            duration_ns: Vec::new(),
+            name: Vec::new(),
+            props: Vec::new(),
+            prop_key: Vec::new(),
+            prop_val: Vec::new(),
+            events: Vec::new(),
+            event_name: Vec::new(),
+            event_timestamp_unix_ns: Vec::new(),
+            event_props: Vec::new(),
+            event_prop_key: Vec::new(),
+            event_prop_val: Vec::new(),
+            strings: Vec::new(),
+            index: HashMap::new(),
+        }
+    }
+
+    fn clear(&mut self) {
+        self.trace_id_high.clear();
+        self.trace_id_low.clear();
+        self.span_id.clear();
+        self.parent_id.clear();
+        self.begin_unix_ns.clear();
+        self.duration_ns.clear();
+        self.name.clear();
+        self.props.clear();
+        self.prop_key.clear();
+        self.prop_val.clear();
+        self.events.clear();
+        self.event_name.clear();
+        self.event_timestamp_unix_ns.clear();
+        self.event_props.clear();
+        self.event_prop_key.clear();
+        self.event_prop_val.clear();
+        self.strings.clear();
+        self.index.clear();
+    }
+
+    fn string(&mut self, s: &str) -> u32 {
+        let next = self.strings.len() as u32;
+        let index = *self.index.entry(Key(Str::new(s))).or_insert(next);
+        if index == next {
+            self.strings.push(Str::new(s));
+        }
+        index
+    }
+}
+
+impl Reporter for ColumnarReporter {
+    fn report(&mut self, spans: Vec<SpanRecord>) {
+        if spans.is_empty() {
+            return;
+        }
+
+        self.clear();
+        self.props.push(0);
+        self.events.push(0);
+        self.event_props.push(0);
+        for span in &spans {
+            self.trace_id_high.push((span.trace_id.0 >> 64) as u64);
+            self.trace_id_low.push(span.trace_id.0 as u64);
+            self.span_id.push(span.span_id.0);
+            self.parent_id.push(span.parent_id.0);
+            self.begin_unix_ns.push(span.begin_time_unix_ns);
+            self.duration_ns.push(span.duration_ns);
+            let name = self.string(&span.name);
+            self.name.push(name);
+
+            for (key, val) in &span.properties {
+                let (key, val) = (self.string(key), self.string(val));
+                self.prop_key.push(key);
+                self.prop_val.push(val);
+            }
+            self.props.push(self.prop_key.len() as u32);
+
+            for event in &span.events {
+                let name = self.string(&event.name);
+                self.event_name.push(name);
+                self.event_timestamp_unix_ns.push(event.timestamp_unix_ns);
+                for (key, val) in &event.properties {
+                    let (key, val) = (self.string(key), self.string(val));
+                    self.event_prop_key.push(key);
+                    self.event_prop_val.push(val);
+                }
+                self.event_props.push(self.event_prop_key.len() as u32);
+            }
+            self.events.push(self.event_name.len() as u32);
+        }
+
+        let batch = Columns {
+            n: spans.len(),
+            trace_id_high: self.trace_id_high.as_ptr(),
+            trace_id_low: self.trace_id_low.as_ptr(),
+            span_id: self.span_id.as_ptr(),
+            parent_id: self.parent_id.as_ptr(),
+            begin_unix_ns: self.begin_unix_ns.as_ptr(),
+            duration_ns: self.duration_ns.as_ptr(),
+            name: self.name.as_ptr(),
+            props: self.props.as_ptr(),
+            prop_key: self.prop_key.as_ptr(),
+            prop_val: self.prop_val.as_ptr(),
+            events: self.events.as_ptr(),
+            event_name: self.event_name.as_ptr(),
+            event_timestamp_unix_ns: self.event_timestamp_unix_ns.as_ptr(),
+            event_props: self.event_props.as_ptr(),
+            event_prop_key: self.event_prop_key.as_ptr(),
+            event_prop_val: self.event_prop_val.as_ptr(),
+            strings: self.strings.as_ptr(),
+            n_strings: self.strings.len(),
+        };
+        (self.report)(&batch, self.user_data);
+
+        // The keys borrow the records.
+        self.index.clear();
+    }
+}
+
+impl Drop for ColumnarReporter {
+    fn drop(&mut self) {
+        if let Some(drop) = self.drop {
+            drop(self.user_data);
+        }
+    }
+}
@@ -0,0 +1,128 @@
+// Copyright 2023 Wenbo Zhang. Licensed under Apache-2.0.
+
+//! Flushes served by the report thread of `queue`, so that callers neither
+//! block nor spawn a thread of their own.
+
+use std::{
+    sync::{
+        atomic::{AtomicU64, Ordering},
+        Arc, Condvar, Mutex,
+    },
+    time::{Duration, Instant},
+};
+
+use crate::{
+    ffi::ftr_flush_stats,
+    queue,
+    stats::{self, SPANS_REPORTED},
+};
+
+type Done = Box<dyn FnOnce(ftr_flush_stats) + Send>;
+
+/// Must match `FTR_FLUSH_ASYNC_TIMEOUT_MS`.
+const ASYNC_TIMEOUT: Duration = Duration::from_millis(10000);
+
+static NEXT_ID: AtomicU64 = AtomicU64::new(0);
+
+/// A queued flush, reporting the collected spans only until `deadline`.
+pub struct Request {
+    id: u64,
+    pub deadline: Instant,
+    done: Done,
+}
+
+impl Request {
+    fn new(timeout: Duration, done: Done) -> Self {
+        let now = Instant::now();
+        Self {
+            id: NEXT_ID.fetch_add(1, Ordering::Relaxed),
+            // Timeouts too far out to represent never end in practice.
+            deadline: now
+                .checked_add(timeout)
+                .unwrap_or(now + Duration::from_secs(u32::MAX.into())),
+            done,
+        }
+    }
+
+    pub fn id(&self) -> u64 {
+        self.id
+    }
+
+    pub fn complete(self, stats: ftr_flush_stats) {
+        (self.done)(stats)
+    }
+}
+
+/// Counters at the start of a flush, to tell what it did.
+pub struct Snapshot {
+    reported: u64,
+    discarded: u64,
+}
+
+impl Snapshot {
+    pub fn take() -> Self {
+        Self {
+            reported: SPANS_REPORTED.load(Ordering::Relaxed),
+            discarded: stats::discarded(),
+        }
+    }
+
+    pub fn stats(&self, pending: u64) -> ftr_flush_stats {
+        ftr_flush_stats {
+            flushed: SPANS_REPORTED.load(Ordering::Relaxed) - self.reported,
+            dropped: stats::discarded() - self.discarded,
+            pending,
+        }
+    }
+}
+
+/// Queues a flush, returning its id.
+fn queue_flush(timeout: Duration, done: Done) -> u64 {
+    let request = Request::new(timeout, done);
+    let id = request.id;
+    if let Err(request) = queue::request_flush(request) {
+        // Without a reporter, nothing is collected.
+        request.complete(ftr_flush_stats {
+            flushed: 0,
+            dropped: 0,
+            pending: 0,
+        });
+    }
+    id
+}
+
+/// Queues a flush, and calls `done` on the report thread once it completes.
+pub fn flush_async(done: Done) {
+    queue_flush(ASYNC_TIMEOUT, done);
+}
+
+/// Queues a flush and waits for it up to `timeout`.
+pub fn flush_timeout(timeout: Duration) -> Option<ftr_flush_stats> {
+    // The report thread cannot wait for itself, e.g. in a custom reporter.
+    if queue::on_report_thread() {
+        let start = Snapshot::take();
+        let pending = queue::flush();
+        return Some(start.stats(pending));
+    }
+
+    let result = Arc::new((Mutex::new(None), Condvar::new()));
+    let notify = result.clone();
+    let id = queue_flush(
+        timeout,
+        Box::new(move |stats| {
+            let (lock, cvar) = &*notify;
+            *lock.lock().unwrap() = Some(stats);
+            cvar.notify_one();
+        }),
+    );
+
+    let (lock, cvar) = &*result;
+    let (stats, timed_out) = cvar
+        .wait_timeout_while(lock.lock().unwrap(), timeout, |stats| stats.is_none())
+        .unwrap();
+    if timed_out.timed_out() {
+        // Not left behind for a report thread held up by its exporter.
+        queue::cancel_flush(id);
+    }
+    *stats
+}
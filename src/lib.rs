@@ -2,37 +2,223 @@
 
 use std::{
     borrow::Cow,
-    ffi::{c_char, CStr},
+    collections::HashSet,
+    ffi::{c_char, c_void, CStr},
     mem::transmute,
     sync::Mutex,
     time::Duration,
 };
 
 use fastrace::{
-    collector::{Config, ConsoleReporter},
-    local::{LocalCollector, LocalParentGuard},
+    collector::{Config, ConsoleReporter, Reporter, SpanId},
+    local::{LocalCollector, LocalParentGuard, LocalSpans},
     prelude::{LocalSpan, Span, SpanContext},
     Event,
 };
 use fastrace_opentelemetry::OpenTelemetryReporter;
 use once_cell::sync::Lazy;
-use opentelemetry_otlp::WithExportConfig;
-use tokio::runtime::Runtime;
-
-use self::ffi::*;
-
-static RUNTIME: Lazy<Mutex<Runtime>> = Lazy::new(|| {
-    Mutex::new(
-        tokio::runtime::Builder::new_multi_thread()
-            .worker_threads(2)
-            .enable_all()
-            .build()
-            .expect("Failed to create Tokio runtime"),
-    )
-});
 
-fn initialize_runtime() {
-    Lazy::force(&RUNTIME);
+use self::{
+    budget::{BudgetCfg, TraceBudget},
+    custom::{ColumnarReporter, CustomReporter},
+    ffi::*,
+    otlp::{Chunked, TransportCfg},
+    queue::{Queue, QueueCfg},
+    ring::RingReporter,
+    runtime::RuntimeCfg,
+    sampler::SamplerCfg,
+    stats::{Collected, Counted},
+    tail::{TailCfg, TailSampler},
+    timed::Timed,
+};
+
+mod budget;
+mod custom;
+mod flush;
+mod otlp;
+mod propagation;
+mod queue;
+mod ring;
+mod runtime;
+mod sampler;
+mod stats;
+mod tail;
+mod timed;
+
+/// Span names registered through `ftr_register_name`. Entries are leaked so
+/// that the handles handed out stay valid for the lifetime of the process.
+static NAMES: Lazy<Mutex<HashSet<&'static str>>> = Lazy::new(|| Mutex::new(HashSet::new()));
+
+/// `ftr_span::_flags`/`ftr_loc_span::_flags` bit of a span that holds nothing,
+/// e.g. a noop span or a moved-from C++ wrapper. Must match `FTR_SPAN_EMPTY`.
+const SPAN_EMPTY: u64 = 1 << 0;
+
+/// Set with `SPAN_EMPTY` on a span of an unsampled trace, which keeps its
+/// `SpanContext` in place of the span. Must match `FTR_SPAN_CTX`.
+const SPAN_CTX: u64 = 1 << 1;
+
+fn span_new(span: Span) -> ftr_span {
+    stats::span_created();
+    ftr_span {
+        _padding: unsafe { transmute::<Span, [u64; 18]>(span) },
+        _flags: 0,
+    }
+}
+
+fn span_empty() -> ftr_span {
+    ftr_span {
+        _padding: [0; 18],
+        _flags: SPAN_EMPTY,
+    }
+}
+
+fn span_unsampled(ctx: SpanContext) -> ftr_span {
+    let mut span = span_empty();
+    span._padding[..4].copy_from_slice(&unsafe { transmute::<SpanContext, [u64; 4]>(ctx) });
+    span._flags |= SPAN_CTX;
+    span
+}
+
+fn span_ctx_of(span: &ftr_span) -> Option<SpanContext> {
+    if span._flags & SPAN_CTX == 0 {
+        return None;
+    }
+    let mut ctx = [0; 4];
+    ctx.copy_from_slice(&span._padding[..4]);
+    Some(unsafe { transmute::<[u64; 4], SpanContext>(ctx) })
+}
+
+fn span_ref(span: &ftr_span) -> Option<&Span> {
+    if span._flags & SPAN_EMPTY != 0 {
+        return None;
+    }
+    Some(unsafe { transmute::<&[u64; 18], &Span>(&span._padding) })
+}
+
+fn span_mut(span: &mut ftr_span) -> Option<&mut Span> {
+    if span._flags & SPAN_EMPTY != 0 {
+        return None;
+    }
+    Some(unsafe { transmute::<&mut [u64; 18], &mut Span>(&mut span._padding) })
+}
+
+/// Moves the span out of `span` and marks it empty.
+fn span_take(span: &mut ftr_span) -> Option<Span> {
+    if span._flags & SPAN_EMPTY != 0 {
+        return None;
+    }
+    span._flags |= SPAN_EMPTY;
+    Some(unsafe { transmute::<[u64; 18], Span>(span._padding) })
+}
+
+fn loc_span_new(span: LocalSpan) -> ftr_loc_span {
+    stats::span_created();
+    ftr_loc_span {
+        _padding: unsafe { transmute::<LocalSpan, [u64; 3]>(span) },
+        _flags: 0,
+    }
+}
+
+fn loc_span_mut(span: &mut ftr_loc_span) -> Option<&mut LocalSpan> {
+    if span._flags & SPAN_EMPTY != 0 {
+        return None;
+    }
+    Some(unsafe { transmute::<&mut [u64; 3], &mut LocalSpan>(&mut span._padding) })
+}
+
+fn loc_span_take(span: &mut ftr_loc_span) -> Option<LocalSpan> {
+    if span._flags & SPAN_EMPTY != 0 {
+        return None;
+    }
+    span._flags |= SPAN_EMPTY;
+    Some(unsafe { transmute::<[u64; 3], LocalSpan>(span._padding) })
+}
+
+fn name_of(name: ftr_name_id) -> &'static str {
+    unsafe { transmute(name) }
+}
+
+/// Interns `name` in `NAMES`.
+fn intern(name: &str) -> &'static str {
+    let mut names = NAMES.lock().unwrap();
+    match names.get(name) {
+        Some(&interned) => interned,
+        None => {
+            let interned: &'static str = Box::leak(name.into());
+            names.insert(interned);
+            interned
+        }
+    }
+}
+
+/// Layout of `ftr_coll_cfg`: the fastrace `Config`, followed by the settings
+/// that this crate applies itself when the reporter is set.
+#[repr(C)]
+struct CollCfg {
+    config: Config,
+    sampler: SamplerCfg,
+    tail: TailCfg,
+    queue: QueueCfg,
+    budget: BudgetCfg,
+}
+
+fn coll_cfg(cfg: ftr_coll_cfg) -> CollCfg {
+    unsafe { transmute(cfg) }
+}
+
+fn coll_cfg_raw(cfg: CollCfg) -> ftr_coll_cfg {
+    unsafe { transmute(cfg) }
+}
+
+/// Layout of `ftr_otlp_exp_cfg`: the exporter settings, followed by the ones of
+/// the runtime driving the exporters and of their transport.
+#[repr(C)]
+struct OtlpCfg {
+    export: opentelemetry_otlp::ExportConfig,
+    runtime: RuntimeCfg,
+    transport: TransportCfg,
+}
+
+fn otlp_cfg(cfg: ftr_otlp_exp_cfg) -> OtlpCfg {
+    unsafe { transmute(cfg) }
+}
+
+fn otlp_cfg_raw(cfg: OtlpCfg) -> ftr_otlp_exp_cfg {
+    unsafe { transmute(cfg) }
+}
+
+/// Layout of `ftr_otel_rptr`: the reporter, followed by the settings applied
+/// when it is set.
+#[repr(C)]
+struct OtelRptr {
+    reporter: OpenTelemetryReporter,
+    max_batch_bytes: u64,
+}
+
+/// Sets `reporter` as the global reporter, configured with `cfg`.
+fn set_reporter(reporter: impl Reporter, cfg: ftr_coll_cfg) {
+    let cfg = coll_cfg(cfg);
+    sampler::install(&cfg.sampler);
+    set_budget(Queue::new(Counted(reporter), cfg.queue), cfg);
+}
+
+fn set_budget(reporter: impl Reporter, cfg: CollCfg) {
+    if cfg.budget.is_enabled() {
+        set_tail_sampler(TraceBudget::new(reporter, cfg.budget), cfg);
+    } else {
+        set_tail_sampler(reporter, cfg);
+    }
+}
+
+fn set_tail_sampler(reporter: impl Reporter, cfg: CollCfg) {
+    if cfg.tail.is_enabled() {
+        fastrace::set_reporter(
+            Collected(Timed(TailSampler::new(reporter, cfg.tail))),
+            cfg.config,
+        );
+    } else {
+        fastrace::set_reporter(Collected(Timed(reporter)), cfg.config);
+    }
 }
 
 #[cxx::bridge]
@@ -43,19 +229,65 @@ mod ffi {
         _padding: [u64; 4],
     }
 
+    /// Mirrors the public `ftr_collector_stats` struct in `libfastrace.h`.
+    #[namespace = "ffi"]
+    struct ftr_collector_stats {
+        spans_created: u64,
+        spans_collected: u64,
+        spans_reported: u64,
+        spans_dropped: u64,
+        spans_sampled_out: u64,
+        queue_spans: u64,
+        queue_bytes: u64,
+        batches: u64,
+        export_ns: u64,
+        batch_sizes: [u64; 24],
+        export_latencies_us: [u64; 24],
+        exporter_threads_unpinned: u64,
+    }
+
+    /// Spans flushed and dropped by a flush, see `ftr_flush_async`.
+    #[namespace = "ffi"]
+    #[derive(Clone, Copy)]
+    struct ftr_flush_stats {
+        flushed: u64,
+        dropped: u64,
+        pending: u64,
+    }
+
+    #[namespace = "ffi"]
+    struct ftr_name_id {
+        _padding: [u64; 2],
+    }
+
     #[namespace = "ffi"]
     struct ftr_span {
         _padding: [u64; 18],
+        _flags: u64,
+    }
+
+    /// Mirrors the public `ftr_prop` struct in `libfastrace.h`, see `Prop`.
+    #[namespace = "ffi"]
+    struct ftr_prop {
+        _padding: [u64; 5],
+    }
+
+    /// Mirrors the public `ftr_timed_span` struct in `libfastrace.h`, see `TimedSpan`.
+    #[namespace = "ffi"]
+    struct ftr_timed_span {
+        _padding: [u64; 3],
     }
 
     #[namespace = "ffi"]
     struct ftr_loc_par_guar {
         _padding: [u64; 3],
+        _flags: u64,
     }
 
     #[namespace = "ffi"]
     struct ftr_loc_span {
         _padding: [u64; 3],
+        _flags: u64,
     }
 
     #[namespace = "ffi"]
@@ -70,17 +302,17 @@ mod ffi {
 
     #[namespace = "ffi"]
     struct ftr_coll_cfg {
-        _padding: [u64; 5],
+        _padding: [u64; 56],
     }
 
     #[namespace = "ffi"]
     struct ftr_otel_rptr {
-        _padding: [u64; 15],
+        _padding: [u64; 16],
     }
 
     #[namespace = "ffi"]
     struct ftr_otlp_exp_cfg {
-        _padding: [u64; 6],
+        _padding: [u64; 20],
     }
 
     #[namespace = "fastrace_glue"]
@@ -90,7 +322,9 @@ mod ffi {
         fn ftr_create_rand_span_ctx() -> ftr_span_ctx;
 
         /// Creates a `ftr_span_context` from the given [`ftr_span`].
-        fn ftr_create_span_ctx(span: &ftr_span) -> ftr_span_ctx;
+        ///
+        /// Spans that don't record anything yield an unsampled context.
+        unsafe fn ftr_create_span_ctx(span: *const ftr_span) -> ftr_span_ctx;
 
         ///Creates a `ftr_span_context` from the current local parent span.
         fn ftr_create_span_ctx_loc() -> ftr_span_ctx;
@@ -98,8 +332,25 @@ mod ffi {
         /// Sets the `sampled` flag of the `SpanContext`.
         fn ftr_span_ctx_set_sampled(ctx: ftr_span_ctx, sampled: bool) -> ftr_span_ctx;
 
-        /// Create a place-holder span that never starts recording.
-        fn ftr_create_noop_span() -> ftr_span;
+        /// Writes `ctx` as a W3C `traceparent` value to `buf`, returning its length, or 0 if `buf`
+        /// is too short.
+        fn ftr_span_ctx_encode_w3c(ctx: ftr_span_ctx, buf: &mut [u8]) -> usize;
+
+        /// Parses a W3C `traceparent` value into `ctx`, returning false if it is invalid.
+        fn ftr_span_ctx_decode_w3c(value: &[u8], ctx: &mut ftr_span_ctx) -> bool;
+
+        /// Writes the 26-byte binary encoding of `ctx` to `buf`, returning its length, or 0 if
+        /// `buf` is too short.
+        fn ftr_span_ctx_encode_bin(ctx: ftr_span_ctx, buf: &mut [u8]) -> usize;
+
+        /// Parses the binary encoding at the start of `buf` into `ctx`, returning false if it is
+        /// invalid.
+        fn ftr_span_ctx_decode_bin(buf: &[u8], ctx: &mut ftr_span_ctx) -> bool;
+
+        /// Register a span name once and return a handle for the `*_id` span constructors.
+        ///
+        /// Registering the same name again returns the same handle.
+        fn ftr_register_name(name: &str) -> ftr_name_id;
 
         /// Create a new trace and return its root span.
         ///
@@ -107,14 +358,51 @@ mod ffi {
         fn ftr_create_root_span(name: &'static str, parent: ftr_span_ctx) -> ftr_span;
 
         /// Create a new child span associated with the specified parent span.
-        fn ftr_create_child_span_enter(name: &'static str, parent: &ftr_span) -> ftr_span;
+        ///
+        /// A null or empty parent yields an empty span.
+        unsafe fn ftr_create_child_span_enter(
+            name: &'static str,
+            parent: *const ftr_span,
+        ) -> ftr_span;
 
         /// Create a new child span associated with multiple parent spans.
         fn ftr_create_child_span_enter_mul(name: &'static str, parents: &[ftr_span]) -> ftr_span;
 
+        /// Create one child span of `parent` per name into `out`, whose length must match.
+        unsafe fn ftr_create_child_spans_enter_batch(
+            names: &[*const c_char],
+            parent: *const ftr_span,
+            out: &mut [ftr_span],
+        );
+
+        /// Same as `ftr_create_child_spans_enter_batch`, with names from `ftr_register_name`.
+        unsafe fn ftr_create_child_spans_enter_batch_id(
+            names: &[ftr_name_id],
+            parent: *const ftr_span,
+            out: &mut [ftr_span],
+        );
+
         /// Create a new child span associated with the current local span in the current thread.
         fn ftr_create_child_span_enter_loc(name: &'static str) -> ftr_span;
 
+        /// Record finished child spans of `span` with the given start and end timestamps.
+        fn ftr_create_child_spans_at(span: &ftr_span, spans: &[ftr_timed_span]);
+
+        /// Same as `ftr_create_root_span`, with a name registered by `ftr_register_name`.
+        fn ftr_create_root_span_id(name: ftr_name_id, parent: ftr_span_ctx) -> ftr_span;
+
+        /// Same as `ftr_create_child_span_enter`, with a name registered by `ftr_register_name`.
+        unsafe fn ftr_create_child_span_enter_id(
+            name: ftr_name_id,
+            parent: *const ftr_span,
+        ) -> ftr_span;
+
+        /// Same as `ftr_create_child_span_enter_mul`, with a name registered by `ftr_register_name`.
+        fn ftr_create_child_span_enter_mul_id(name: ftr_name_id, parents: &[ftr_span]) -> ftr_span;
+
+        /// Same as `ftr_create_child_span_enter_loc`, with a name registered by `ftr_register_name`.
+        fn ftr_create_child_span_enter_loc_id(name: ftr_name_id) -> ftr_span;
+
         /// Dismisses the trace, preventing the reporting of any span records associated with it.
         ///
         /// This is particularly useful when focusing on the tail latency of a program. For instant,
@@ -124,13 +412,15 @@ mod ffi {
         ///
         /// This method only dismisses the entire trace when called on the root span.
         /// If called on a non-root span, it will only cancel the reporting of that specific span.
-        fn ftr_cancel_span(span: ftr_span);
+        unsafe fn ftr_cancel_span(span: *mut ftr_span);
 
         /// Returns the elapsed time since the span was created.
-        fn ftr_span_elapsed(span: &ftr_span) -> u64;
+        unsafe fn ftr_span_elapsed(span: *const ftr_span) -> u64;
 
         /// Once destroyed (dropped), the root span automatically submits all associated child spans to the reporter.
-        fn ftr_destroy_span(span: ftr_span);
+        ///
+        /// The span is moved out of `span`, which must not be used again.
+        unsafe fn ftr_destroy_span(span: *mut ftr_span);
 
         /// Sets the current `ftr_pan` as the local parent for the current thread.
         ///
@@ -138,7 +428,7 @@ mod ffi {
         ///
         /// A local parent is necessary for creating a [`ftr_local_span`] using [`ftr_create_loc_span_enter()`].
         /// If no local parent is set, `ftr_create_loc_span_enter()` will not perform any action.
-        fn ftr_set_loc_par_to_span(span: &ftr_span) -> ftr_loc_par_guar;
+        unsafe fn ftr_set_loc_par_to_span(span: *const ftr_span) -> ftr_loc_par_guar;
 
         /// Add a single property to the `Span` and return the modified `Span`.
         ///
@@ -148,6 +438,23 @@ mod ffi {
         /// Add multiple properties to the `Span` and return the modified `Span`.
         fn ftr_span_with_props(span: &mut ftr_span, keys: &[*const c_char], vals: &[*const c_char]);
 
+        /// Same as `ftr_span_with_prop`, with a numeric value that is only formatted if the span is recorded.
+        fn ftr_span_with_prop_i64(span: &mut ftr_span, key: &'static str, val: i64);
+
+        /// Same as `ftr_span_with_prop`, with a numeric value that is only formatted if the span is recorded.
+        fn ftr_span_with_prop_u64(span: &mut ftr_span, key: &'static str, val: u64);
+
+        /// Same as `ftr_span_with_prop`, with a numeric value that is only formatted if the span is recorded.
+        fn ftr_span_with_prop_f64(span: &mut ftr_span, key: &'static str, val: f64);
+
+        /// Same as `ftr_span_with_prop`, with a boolean value.
+        fn ftr_span_with_prop_bool(span: &mut ftr_span, key: &'static str, val: bool);
+
+        /// Add multiple properties with explicit lengths to the `Span`.
+        ///
+        /// Keys and values flagged as static are borrowed rather than copied.
+        fn ftr_span_with_props_ex(span: &mut ftr_span, props: &[ftr_prop]);
+
         /// Adds an event to the parent span with the given name and properties.
         fn ftr_add_ent_to_par(
             name: &'static str,
@@ -156,6 +463,9 @@ mod ffi {
             vals: &[*const c_char],
         );
 
+        /// Same as `ftr_add_ent_to_par`, with properties of explicit lengths.
+        fn ftr_add_ent_to_par_ex(name: &'static str, parent: &ftr_span, props: &[ftr_prop]);
+
         fn ftr_destroy_loc_par_guar(guard: ftr_loc_par_guar);
 
         /// Attach a collection of [`ftr_local_span`] instances as child spans to the current span.
@@ -185,19 +495,49 @@ mod ffi {
         /// it will become the new local parent.
         fn ftr_create_loc_span_enter(name: &'static str) -> ftr_loc_span;
 
+        /// Same as `ftr_create_loc_span_enter`, with a name registered by `ftr_register_name`.
+        fn ftr_create_loc_span_enter_id(name: ftr_name_id) -> ftr_loc_span;
+
         /// Add a single property to the current local parent. If the local parent is a [`Span`],
         /// the property will be added to the `Span`.
         fn ftr_loc_span_add_prop(key: &'static str, val: &'static str);
 
+        /// Same as `ftr_loc_span_add_prop`, with a numeric value that is only formatted if the span is recorded.
+        fn ftr_loc_span_add_prop_i64(key: &'static str, val: i64);
+
+        /// Same as `ftr_loc_span_add_prop`, with a numeric value that is only formatted if the span is recorded.
+        fn ftr_loc_span_add_prop_u64(key: &'static str, val: u64);
+
+        /// Same as `ftr_loc_span_add_prop`, with a numeric value that is only formatted if the span is recorded.
+        fn ftr_loc_span_add_prop_f64(key: &'static str, val: f64);
+
+        /// Same as `ftr_loc_span_add_prop`, with a boolean value.
+        fn ftr_loc_span_add_prop_bool(key: &'static str, val: bool);
+
         /// Add multiple properties to the current local parent. If the local parent is a [`Span`],
         /// the properties will be added to the `Span`.
         fn ftr_loc_span_add_props(keys: &[*const c_char], vals: &[*const c_char]);
 
+        /// Same as `ftr_loc_span_add_props`, with properties of explicit lengths.
+        fn ftr_loc_span_add_props_ex(props: &[ftr_prop]);
+
         /// Add a single property to the `LocalSpan` and return the modified `LocalSpan`.
         ///
         /// A property is an arbitrary key-value pair associated with a span.
         fn ftr_loc_span_with_prop(span: &mut ftr_loc_span, key: &'static str, val: &'static str);
 
+        /// Same as `ftr_loc_span_with_prop`, with a numeric value that is only formatted if the span is recorded.
+        fn ftr_loc_span_with_prop_i64(span: &mut ftr_loc_span, key: &'static str, val: i64);
+
+        /// Same as `ftr_loc_span_with_prop`, with a numeric value that is only formatted if the span is recorded.
+        fn ftr_loc_span_with_prop_u64(span: &mut ftr_loc_span, key: &'static str, val: u64);
+
+        /// Same as `ftr_loc_span_with_prop`, with a numeric value that is only formatted if the span is recorded.
+        fn ftr_loc_span_with_prop_f64(span: &mut ftr_loc_span, key: &'static str, val: f64);
+
+        /// Same as `ftr_loc_span_with_prop`, with a boolean value.
+        fn ftr_loc_span_with_prop_bool(span: &mut ftr_loc_span, key: &'static str, val: bool);
+
         /// Add multiple properties to the `LocalSpan` and return the modified `LocalSpan`.
         fn ftr_loc_span_with_props(
             span: &mut ftr_loc_span,
@@ -205,6 +545,9 @@ mod ffi {
             vals: &[*const c_char],
         );
 
+        /// Same as `ftr_loc_span_with_props`, with properties of explicit lengths.
+        fn ftr_loc_span_with_props_ex(span: &mut ftr_loc_span, props: &[ftr_prop]);
+
         /// Adds an event to the current local parent span with the given name and properties.
         fn ftr_add_ent_to_loc_par(
             name: &'static str,
@@ -212,7 +555,11 @@ mod ffi {
             vals: &[*const c_char],
         );
 
-        fn ftr_destroy_loc_span(span: ftr_loc_span);
+        /// Same as `ftr_add_ent_to_loc_par`, with properties of explicit lengths.
+        fn ftr_add_ent_to_loc_par_ex(name: &'static str, props: &[ftr_prop]);
+
+        /// The local span is moved out of `span`, which must not be used again.
+        unsafe fn ftr_destroy_loc_span(span: *mut ftr_loc_span);
 
         /// Collect local spans manually without a parent, see `ftr_push_child_spans_to_cur` to learn more.
         fn ftr_start_loc_coll() -> ftr_loc_coll;
@@ -231,6 +578,9 @@ mod ffi {
         /// Root span will always be collected. The eventually collected spans may exceed the limit.
         fn ftr_set_max_spans_per_trace(cfg: ftr_coll_cfg, mspt: usize) -> ftr_coll_cfg;
 
+        /// Keeps at most `n` estimated bytes of spans per trace, 0 for no limit.
+        fn ftr_set_max_bytes_per_trace(cfg: ftr_coll_cfg, n: usize) -> ftr_coll_cfg;
+
         /// The time duration between two batch reports.
         ///
         /// The default value is 500 milliseconds.
@@ -241,11 +591,101 @@ mod ffi {
         /// - When the number of spans in a batch hits its limit.
         fn ftr_set_report_interval(cfg: ftr_coll_cfg, ri: u64) -> ftr_coll_cfg;
 
+        /// Keeps the given ratio of traces, decided on the trace id when the root span is created.
+        fn ftr_set_sample_ratio(cfg: ftr_coll_cfg, ratio: f64) -> ftr_coll_cfg;
+
+        /// Keeps at most `per_sec` traces per second, with bursts of up to `burst` traces.
+        fn ftr_set_sample_rate_limit(cfg: ftr_coll_cfg, per_sec: f64, burst: u64) -> ftr_coll_cfg;
+
+        /// Same as `ftr_set_sample_ratio`, for root spans named `name` only.
+        fn ftr_set_root_sample_ratio(cfg: ftr_coll_cfg, name: &str, ratio: f64) -> ftr_coll_cfg;
+
+        /// Same as `ftr_set_sample_rate_limit`, for root spans named `name` only.
+        fn ftr_set_root_sample_rate_limit(
+            cfg: ftr_coll_cfg,
+            name: &str,
+            per_sec: f64,
+            burst: u64,
+        ) -> ftr_coll_cfg;
+
+        /// Tail sampling: keeps the traces whose root span lasts at least `ns` nanoseconds.
+        fn ftr_set_tail_min_duration(cfg: ftr_coll_cfg, ns: u64) -> ftr_coll_cfg;
+
+        /// Tail sampling: keeps the traces whose root span lasts at least the given percentile
+        /// of the root spans with the same name.
+        fn ftr_set_tail_percentile(cfg: ftr_coll_cfg, percentile: f64) -> ftr_coll_cfg;
+
+        /// Tail sampling: keeps the traces with a span carrying the property `key`.
+        fn ftr_set_tail_error_prop(cfg: ftr_coll_cfg, key: &str) -> ftr_coll_cfg;
+
+        /// Caps the number of spans buffered between the collector and the reporter, 0 for no
+        /// cap. The reporter then runs on a thread of its own.
+        fn ftr_set_queue_max_spans(cfg: ftr_coll_cfg, n: usize) -> ftr_coll_cfg;
+
+        /// Caps the estimated bytes buffered between the collector and the reporter, 0 for no
+        /// cap. The reporter then runs on a thread of its own.
+        fn ftr_set_queue_max_bytes(cfg: ftr_coll_cfg, n: usize) -> ftr_coll_cfg;
+
+        /// What to do with new spans when the queue is full, see `ftr_overflow`.
+        fn ftr_set_queue_overflow(cfg: ftr_coll_cfg, policy: u32) -> ftr_coll_cfg;
+
+        /// Returns the counters of the collector.
+        fn ftr_get_collector_stats() -> ftr_collector_stats;
+
+        /// Returns the clock timestamping the spans, see `ftr_clock_source`.
+        fn ftr_get_clock_source() -> u32;
+
         /// Sets console reporter for the current application, usually used for debugging.
         fn ftr_set_cons_rptr();
 
+        /// Sets a reporter appending span records to a ring of `files` memory-mapped files of
+        /// `file_bytes` bytes each in `dir`. Returns false if the files could not be set up.
+        fn ftr_set_ring_rptr(dir: &str, file_bytes: usize, files: usize, cfg: ftr_coll_cfg)
+            -> bool;
+
+        /// Sets a reporter calling `report` with views of each batch of spans. `drop`, if set, is
+        /// called with `user_data` once the reporter is replaced.
+        fn ftr_set_custom_rptr(report: usize, drop: usize, user_data: usize, cfg: ftr_coll_cfg);
+
+        /// Same as `ftr_set_custom_rptr`, handing each batch to `report` as columns.
+        fn ftr_set_columnar_rptr(report: usize, drop: usize, user_data: usize, cfg: ftr_coll_cfg);
+
         fn ftr_create_def_otlp_exp_cfg() -> ftr_otlp_exp_cfg;
 
+        /// Runs the exporters on a pool of `n` threads, 2 by default.
+        fn ftr_set_otlp_rt_workers(cfg: ftr_otlp_exp_cfg, n: usize) -> ftr_otlp_exp_cfg;
+
+        /// Pins the exporter threads to the given CPUs.
+        fn ftr_set_otlp_rt_cpus(cfg: ftr_otlp_exp_cfg, cpus: &[u32]) -> ftr_otlp_exp_cfg;
+
+        /// Runs the exporters on a single thread.
+        fn ftr_set_otlp_rt_cur_thread(cfg: ftr_otlp_exp_cfg) -> ftr_otlp_exp_cfg;
+
+        /// Runs the exporters on a single thread obtained from the application through `spawn`.
+        fn ftr_set_otlp_rt_spawner(
+            cfg: ftr_otlp_exp_cfg,
+            spawn: usize,
+            user_data: usize,
+        ) -> ftr_otlp_exp_cfg;
+
+        /// Exports over `protocol`, see `ftr_otlp_protocol`.
+        fn ftr_set_otlp_protocol(cfg: ftr_otlp_exp_cfg, protocol: u32) -> ftr_otlp_exp_cfg;
+
+        /// Exports to `endpoint`, in place of `OTEL_EXPORTER_OTLP_ENDPOINT` or the default one.
+        fn ftr_set_otlp_endpoint(cfg: ftr_otlp_exp_cfg, endpoint: &str) -> ftr_otlp_exp_cfg;
+
+        /// Compresses the exports, see `ftr_otlp_compression`.
+        fn ftr_set_otlp_compression(cfg: ftr_otlp_exp_cfg, compression: u32) -> ftr_otlp_exp_cfg;
+
+        /// Sends the header `key: val` with every export.
+        fn ftr_add_otlp_header(cfg: ftr_otlp_exp_cfg, key: &str, val: &str) -> ftr_otlp_exp_cfg;
+
+        /// Gives up on an export after `ms` milliseconds.
+        fn ftr_set_otlp_timeout(cfg: ftr_otlp_exp_cfg, ms: u64) -> ftr_otlp_exp_cfg;
+
+        /// Splits the batches so that each export holds at most about `n` bytes of spans.
+        fn ftr_set_otlp_max_batch_bytes(cfg: ftr_otlp_exp_cfg, n: usize) -> ftr_otlp_exp_cfg;
+
         /// Create an `ftr_otel_rptr` to export trace records to remote agents that OpenTelemetry
         /// supports, which includes Jaeger, Datadog, Zipkin, and OpenTelemetry Collector.
         fn ftr_create_otel_rptr(cfg: ftr_otlp_exp_cfg) -> ftr_otel_rptr;
@@ -262,6 +702,14 @@ mod ffi {
         /// It will create a new thread in the current thread to do this,
         /// and it will block the current thread until the new thread finishes flushing and exits.
         fn ftr_flush();
+
+        /// Queues a flush on the report thread and returns at once. `cb`, if not 0, is called with
+        /// `user_data` on that thread once done.
+        fn ftr_flush_async(cb: usize, user_data: usize);
+
+        /// Queues a flush on the report thread and waits for it up to `ms` milliseconds. Returns
+        /// whether it completed, in which case `stats` is filled in.
+        fn ftr_flush_timeout(ms: u64, stats: &mut ftr_flush_stats) -> bool;
     }
 }
 
@@ -269,66 +717,233 @@ pub fn ftr_create_rand_span_ctx() -> ftr_span_ctx {
     unsafe { transmute(SpanContext::random()) }
 }
 
-pub fn ftr_create_span_ctx(span: &ftr_span) -> ftr_span_ctx {
-    unsafe { transmute(SpanContext::from_span(transmute(span)).unwrap()) }
+pub unsafe fn ftr_create_span_ctx(span: *const ftr_span) -> ftr_span_ctx {
+    let ctx = span
+        .as_ref()
+        .and_then(|span| {
+            span_ref(span)
+                .and_then(SpanContext::from_span)
+                .or_else(|| span_ctx_of(span))
+        })
+        .unwrap_or_else(|| SpanContext::random().sampled(false));
+    transmute(ctx)
 }
 
 pub fn ftr_create_span_ctx_loc() -> ftr_span_ctx {
-    unsafe { transmute(SpanContext::current_local_parent().unwrap()) }
+    let ctx = SpanContext::current_local_parent()
+        .unwrap_or_else(|| SpanContext::random().sampled(false));
+    unsafe { transmute(ctx) }
 }
 
 pub fn ftr_span_ctx_set_sampled(ctx: ftr_span_ctx, sampled: bool) -> ftr_span_ctx {
     unsafe { transmute(transmute::<ftr_span_ctx, SpanContext>(ctx).sampled(sampled)) }
 }
 
-pub fn ftr_create_noop_span() -> ftr_span {
-    unsafe { transmute(Span::noop()) }
+pub fn ftr_span_ctx_encode_w3c(ctx: ftr_span_ctx, buf: &mut [u8]) -> usize {
+    propagation::encode_w3c(&unsafe { transmute::<ftr_span_ctx, SpanContext>(ctx) }, buf)
+}
+
+pub fn ftr_span_ctx_decode_w3c(value: &[u8], ctx: &mut ftr_span_ctx) -> bool {
+    match propagation::decode_w3c(value) {
+        Some(decoded) => {
+            *ctx = unsafe { transmute::<SpanContext, ftr_span_ctx>(decoded) };
+            true
+        }
+        None => false,
+    }
+}
+
+pub fn ftr_span_ctx_encode_bin(ctx: ftr_span_ctx, buf: &mut [u8]) -> usize {
+    propagation::encode_bin(&unsafe { transmute::<ftr_span_ctx, SpanContext>(ctx) }, buf)
+}
+
+pub fn ftr_span_ctx_decode_bin(buf: &[u8], ctx: &mut ftr_span_ctx) -> bool {
+    match propagation::decode_bin(buf) {
+        Some(decoded) => {
+            *ctx = unsafe { transmute::<SpanContext, ftr_span_ctx>(decoded) };
+            true
+        }
+        None => false,
+    }
+}
+
+pub fn ftr_register_name(name: &str) -> ftr_name_id {
+    unsafe { transmute(intern(name)) }
 }
 
 pub fn ftr_create_root_span(name: &'static str, parent: ftr_span_ctx) -> ftr_span {
-    unsafe { transmute(Span::root(name, transmute(parent))) }
+    let parent = unsafe { transmute::<ftr_span_ctx, SpanContext>(parent) };
+    // Nothing of an unsampled trace gets reported, so skip the span entirely and
+    // only keep the context for propagation.
+    if !parent.sampled || !sampler::sample(name, parent.trace_id) {
+        return span_unsampled(SpanContext::new(parent.trace_id, SpanId::random()).sampled(false));
+    }
+    span_new(Span::root(name, parent))
 }
 
-pub fn ftr_create_child_span_enter(name: &'static str, parent: &ftr_span) -> ftr_span {
-    unsafe { transmute(Span::enter_with_parent(name, transmute(parent))) }
+pub unsafe fn ftr_create_child_span_enter(name: &'static str, parent: *const ftr_span) -> ftr_span {
+    match parent.as_ref() {
+        Some(parent) => match span_ref(parent) {
+            Some(span) => span_new(Span::enter_with_parent(name, span)),
+            None => ftr_span { ..*parent },
+        },
+        None => span_empty(),
+    }
 }
 
 pub fn ftr_create_child_span_enter_mul(name: &'static str, parents: &[ftr_span]) -> ftr_span {
-    unsafe {
-        transmute(Span::enter_with_parents(
-            name,
-            parents.iter().map(|p| transmute::<&ftr_span, &Span>(p)),
-        ))
+    // Without a live parent, stay inline like `ftr_create_child_span_enter`:
+    // carry the unsampled context of the first parent that has one, if any.
+    if !parents.iter().any(|parent| span_ref(parent).is_some()) {
+        return parents
+            .iter()
+            .find(|parent| parent._flags & SPAN_CTX != 0)
+            .map(|parent| ftr_span { ..*parent })
+            .unwrap_or_else(span_empty);
+    }
+    span_new(Span::enter_with_parents(
+        name,
+        parents.iter().filter_map(span_ref),
+    ))
+}
+
+pub unsafe fn ftr_create_child_spans_enter_batch(
+    names: &[*const c_char],
+    parent: *const ftr_span,
+    out: &mut [ftr_span],
+) {
+    create_children(
+        parent,
+        out,
+        names
+            .iter()
+            .map(|&name| CStr::from_ptr(name).to_str().unwrap_or("<invalid utf-8>")),
+    )
+}
+
+pub unsafe fn ftr_create_child_spans_enter_batch_id(
+    names: &[ftr_name_id],
+    parent: *const ftr_span,
+    out: &mut [ftr_span],
+) {
+    create_children(parent, out, names.iter().map(|&name| name_of(name)))
+}
+
+/// Fills `out` with children of `parent`, one per name.
+unsafe fn create_children(
+    parent: *const ftr_span,
+    out: &mut [ftr_span],
+    names: impl Iterator<Item = &'static str>,
+) {
+    let parent = parent.as_ref();
+    let span = parent.and_then(span_ref);
+    for (out, name) in out.iter_mut().zip(names) {
+        *out = match (parent, span) {
+            (_, Some(span)) => span_new(Span::enter_with_parent(name, span)),
+            (Some(parent), None) => ftr_span { ..*parent },
+            (None, None) => span_empty(),
+        };
     }
 }
 
 pub fn ftr_create_child_span_enter_loc(name: &'static str) -> ftr_span {
-    unsafe { transmute(Span::enter_with_local_parent(name)) }
+    span_new(Span::enter_with_local_parent(name))
 }
 
-pub fn ftr_cancel_span(span: ftr_span) {
-    unsafe { transmute::<ftr_span, Span>(span).cancel() }
+pub fn ftr_create_root_span_id(name: ftr_name_id, parent: ftr_span_ctx) -> ftr_span {
+    ftr_create_root_span(name_of(name), parent)
 }
 
-pub fn ftr_span_elapsed(span: &ftr_span) -> u64 {
-    let span = unsafe { transmute::<&ftr_span, &Span>(span) };
-    span.elapsed().map(|d| d.as_nanos() as u64).unwrap_or(0)
+pub unsafe fn ftr_create_child_span_enter_id(
+    name: ftr_name_id,
+    parent: *const ftr_span,
+) -> ftr_span {
+    ftr_create_child_span_enter(name_of(name), parent)
 }
 
-pub fn ftr_destroy_span(span: ftr_span) {
-    unsafe { drop(transmute::<ftr_span, Span>(span)) }
+pub fn ftr_create_child_span_enter_mul_id(name: ftr_name_id, parents: &[ftr_span]) -> ftr_span {
+    ftr_create_child_span_enter_mul(name_of(name), parents)
+}
+
+pub fn ftr_create_child_span_enter_loc_id(name: ftr_name_id) -> ftr_span {
+    ftr_create_child_span_enter_loc(name_of(name))
+}
+
+pub unsafe fn ftr_cancel_span(span: *mut ftr_span) {
+    if let Some(mut span) = span_take(&mut *span) {
+        span.cancel()
+    }
 }
 
-pub fn ftr_set_loc_par_to_span(span: &ftr_span) -> ftr_loc_par_guar {
-    unsafe { transmute(transmute::<&ftr_span, &Span>(span).set_local_parent()) }
+pub unsafe fn ftr_span_elapsed(span: *const ftr_span) -> u64 {
+    span.as_ref()
+        .and_then(span_ref)
+        .and_then(Span::elapsed)
+        .map(|d| d.as_nanos() as u64)
+        .unwrap_or(0)
+}
+
+pub unsafe fn ftr_destroy_span(span: *mut ftr_span) {
+    drop(span_take(&mut *span))
+}
+
+pub unsafe fn ftr_set_loc_par_to_span(span: *const ftr_span) -> ftr_loc_par_guar {
+    let guard = match span.as_ref().and_then(span_ref) {
+        Some(span) => span.set_local_parent(),
+        None => Span::noop().set_local_parent(),
+    };
+    ftr_loc_par_guar {
+        _padding: transmute::<LocalParentGuard, [u64; 3]>(guard),
+        _flags: 0,
+    }
 }
 
 pub fn ftr_span_with_prop(span: &mut ftr_span, key: &'static str, val: &'static str) {
-    let span = unsafe { transmute::<&mut ftr_span, &mut Span>(span) };
+    let Some(span) = span_mut(span) else {
+        return;
+    };
     let owned = std::mem::replace(span, Span::noop());
     *span = owned.with_property(|| (key, val));
 }
 
+fn bool_str(val: bool) -> &'static str {
+    if val {
+        "true"
+    } else {
+        "false"
+    }
+}
+
+/// Values are formatted inside the property closure, which fastrace only calls
+/// for spans that are recorded.
+fn span_with_typed_prop<V: Into<Cow<'static, str>>>(
+    span: &mut ftr_span,
+    key: &'static str,
+    val: impl FnOnce() -> V,
+) {
+    let Some(span) = span_mut(span) else {
+        return;
+    };
+    let owned = std::mem::take(span);
+    *span = owned.with_property(|| (key, val()));
+}
+
+pub fn ftr_span_with_prop_i64(span: &mut ftr_span, key: &'static str, val: i64) {
+    span_with_typed_prop(span, key, move || val.to_string())
+}
+
+pub fn ftr_span_with_prop_u64(span: &mut ftr_span, key: &'static str, val: u64) {
+    span_with_typed_prop(span, key, move || val.to_string())
+}
+
+pub fn ftr_span_with_prop_f64(span: &mut ftr_span, key: &'static str, val: f64) {
+    span_with_typed_prop(span, key, move || val.to_string())
+}
+
+pub fn ftr_span_with_prop_bool(span: &mut ftr_span, key: &'static str, val: bool) {
+    span_with_typed_prop(span, key, move || bool_str(val))
+}
+
 fn convert_c_str_arrays<'a>(
     keys: &'a [*const c_char],
     vals: &'a [*const c_char],
@@ -341,20 +956,74 @@ fn convert_c_str_arrays<'a>(
     })
 }
 
+/// Layout of `ftr_prop` as declared in `libfastrace.h`.
+#[repr(C)]
+struct Prop {
+    key: *const u8,
+    key_len: usize,
+    val: *const u8,
+    val_len: usize,
+    flags: u32,
+}
+
+const PROP_KEY_STATIC: u32 = 1 << 0;
+const PROP_VAL_STATIC: u32 = 1 << 1;
+
+unsafe fn prop_str(ptr: *const u8, len: usize, borrow: bool) -> Cow<'static, str> {
+    if len == 0 {
+        return Cow::Borrowed("");
+    }
+    let bytes = std::slice::from_raw_parts(ptr, len);
+    if borrow {
+        Cow::Borrowed(std::str::from_utf8_unchecked(bytes))
+    } else {
+        String::from_utf8_lossy(bytes).into_owned().into()
+    }
+}
+
+fn convert_props(
+    props: &[ftr_prop],
+) -> impl Iterator<Item = (Cow<'static, str>, Cow<'static, str>)> + '_ {
+    let props = unsafe { std::slice::from_raw_parts(props.as_ptr() as *const Prop, props.len()) };
+    // Keys starting with a NUL are reserved, see `timed::TIMESTAMPS`.
+    props
+        .iter()
+        .filter(|p| p.key_len == 0 || unsafe { *p.key } != 0)
+        .map(|p| unsafe {
+            (
+                prop_str(p.key, p.key_len, p.flags & PROP_KEY_STATIC != 0),
+                prop_str(p.val, p.val_len, p.flags & PROP_VAL_STATIC != 0),
+            )
+        })
+}
+
 pub fn ftr_span_with_props(span: &mut ftr_span, keys: &[*const c_char], vals: &[*const c_char]) {
-    let span = unsafe { transmute::<&mut ftr_span, &mut Span>(span) };
+    let Some(span) = span_mut(span) else {
+        return;
+    };
     let props = convert_c_str_arrays(keys, vals);
     let owned = std::mem::take(span);
     *span = owned.with_properties(move || props);
 }
 
+pub fn ftr_span_with_props_ex(span: &mut ftr_span, props: &[ftr_prop]) {
+    let Some(span) = span_mut(span) else {
+        return;
+    };
+    let props = convert_props(props);
+    let owned = std::mem::take(span);
+    *span = owned.with_properties(move || props);
+}
+
 pub fn ftr_add_ent_to_par(
     name: &'static str,
     parent: &ftr_span,
     keys: &[*const c_char],
     vals: &[*const c_char],
 ) {
-    let parent = unsafe { transmute::<&ftr_span, &Span>(parent) };
+    let Some(parent) = span_ref(parent) else {
+        return;
+    };
     Event::add_to_parent(name, parent, || {
         keys.iter().zip(vals.iter()).map(|(&key, &val)| unsafe {
             (
@@ -365,22 +1034,61 @@ pub fn ftr_add_ent_to_par(
     });
 }
 
+pub fn ftr_add_ent_to_par_ex(name: &'static str, parent: &ftr_span, props: &[ftr_prop]) {
+    let Some(parent) = span_ref(parent) else {
+        return;
+    };
+    Event::add_to_parent(name, parent, || convert_props(props));
+}
+
 pub fn ftr_destroy_loc_par_guar(guard: ftr_loc_par_guar) {
-    unsafe { drop(transmute::<ftr_loc_par_guar, LocalParentGuard>(guard)) }
+    if guard._flags & SPAN_EMPTY != 0 {
+        return;
+    }
+    unsafe { drop(transmute::<[u64; 3], LocalParentGuard>(guard._padding)) }
 }
 
 pub fn ftr_push_child_spans_to_cur(span: &ftr_span, local_span: ftr_loc_spans) {
-    unsafe { transmute::<&ftr_span, &Span>(span).push_child_spans(transmute(local_span)) }
+    let local_span = unsafe { transmute::<ftr_loc_spans, LocalSpans>(local_span) };
+    if let Some(span) = span_ref(span) {
+        span.push_child_spans(local_span)
+    }
+}
+
+pub fn ftr_create_child_spans_at(span: &ftr_span, spans: &[ftr_timed_span]) {
+    if let Some(span) = span_ref(span) {
+        timed::record(span, spans)
+    }
 }
 
 pub fn ftr_create_loc_span_enter(name: &'static str) -> ftr_loc_span {
-    unsafe { transmute(LocalSpan::enter_with_local_parent(name)) }
+    loc_span_new(LocalSpan::enter_with_local_parent(name))
+}
+
+pub fn ftr_create_loc_span_enter_id(name: ftr_name_id) -> ftr_loc_span {
+    ftr_create_loc_span_enter(name_of(name))
 }
 
 pub fn ftr_loc_span_add_prop(key: &'static str, val: &'static str) {
     LocalSpan::add_property(|| (key, val))
 }
 
+pub fn ftr_loc_span_add_prop_i64(key: &'static str, val: i64) {
+    LocalSpan::add_property(|| (key, val.to_string()))
+}
+
+pub fn ftr_loc_span_add_prop_u64(key: &'static str, val: u64) {
+    LocalSpan::add_property(|| (key, val.to_string()))
+}
+
+pub fn ftr_loc_span_add_prop_f64(key: &'static str, val: f64) {
+    LocalSpan::add_property(|| (key, val.to_string()))
+}
+
+pub fn ftr_loc_span_add_prop_bool(key: &'static str, val: bool) {
+    LocalSpan::add_property(|| (key, bool_str(val)))
+}
+
 pub fn ftr_loc_span_add_props(keys: &[*const c_char], vals: &[*const c_char]) {
     LocalSpan::add_properties(|| {
         keys.iter().zip(vals.iter()).map(|(&key, &val)| unsafe {
@@ -392,30 +1100,79 @@ pub fn ftr_loc_span_add_props(keys: &[*const c_char], vals: &[*const c_char]) {
     })
 }
 
+pub fn ftr_loc_span_add_props_ex(props: &[ftr_prop]) {
+    LocalSpan::add_properties(|| convert_props(props))
+}
+
 pub fn ftr_loc_span_with_prop(span: &mut ftr_loc_span, key: &'static str, val: &'static str) {
-    let span = unsafe { transmute::<&mut ftr_loc_span, &mut LocalSpan>(span) };
+    let Some(span) = loc_span_mut(span) else {
+        return;
+    };
     let owned = std::mem::take(span);
     *span = owned.with_property(|| (key, val));
 }
 
+fn loc_span_with_typed_prop<V: Into<Cow<'static, str>>>(
+    span: &mut ftr_loc_span,
+    key: &'static str,
+    val: impl FnOnce() -> V,
+) {
+    let Some(span) = loc_span_mut(span) else {
+        return;
+    };
+    let owned = std::mem::take(span);
+    *span = owned.with_property(|| (key, val()));
+}
+
+pub fn ftr_loc_span_with_prop_i64(span: &mut ftr_loc_span, key: &'static str, val: i64) {
+    loc_span_with_typed_prop(span, key, move || val.to_string())
+}
+
+pub fn ftr_loc_span_with_prop_u64(span: &mut ftr_loc_span, key: &'static str, val: u64) {
+    loc_span_with_typed_prop(span, key, move || val.to_string())
+}
+
+pub fn ftr_loc_span_with_prop_f64(span: &mut ftr_loc_span, key: &'static str, val: f64) {
+    loc_span_with_typed_prop(span, key, move || val.to_string())
+}
+
+pub fn ftr_loc_span_with_prop_bool(span: &mut ftr_loc_span, key: &'static str, val: bool) {
+    loc_span_with_typed_prop(span, key, move || bool_str(val))
+}
+
 pub fn ftr_loc_span_with_props(
     span: &mut ftr_loc_span,
     keys: &[*const c_char],
     vals: &[*const c_char],
 ) {
-    let span = unsafe { std::mem::transmute::<&mut ftr_loc_span, &mut LocalSpan>(span) };
+    let Some(span) = loc_span_mut(span) else {
+        return;
+    };
     let props = convert_c_str_arrays(keys, vals);
     let owned = std::mem::take(span);
     *span = owned.with_properties(move || props);
 }
 
+pub fn ftr_loc_span_with_props_ex(span: &mut ftr_loc_span, props: &[ftr_prop]) {
+    let Some(span) = loc_span_mut(span) else {
+        return;
+    };
+    let props = convert_props(props);
+    let owned = std::mem::take(span);
+    *span = owned.with_properties(move || props);
+}
+
 pub fn ftr_add_ent_to_loc_par(name: &'static str, keys: &[*const c_char], vals: &[*const c_char]) {
     let props = convert_c_str_arrays(keys, vals);
     Event::add_to_local_parent(name, move || props);
 }
 
-pub fn ftr_destroy_loc_span(span: ftr_loc_span) {
-    unsafe { drop(transmute::<ftr_loc_span, LocalSpan>(span)) }
+pub fn ftr_add_ent_to_loc_par_ex(name: &'static str, props: &[ftr_prop]) {
+    Event::add_to_local_parent(name, || convert_props(props));
+}
+
+pub unsafe fn ftr_destroy_loc_span(span: *mut ftr_loc_span) {
+    drop(loc_span_take(&mut *span))
 }
 
 pub fn ftr_start_loc_coll() -> ftr_loc_coll {
@@ -427,77 +1184,290 @@ pub fn ftr_collect_loc_spans(lc: ftr_loc_coll) -> ftr_loc_spans {
 }
 
 pub fn ftr_create_def_coll_cfg() -> ftr_coll_cfg {
-    unsafe { transmute(Config::default()) }
+    coll_cfg_raw(CollCfg {
+        config: Config::default(),
+        sampler: SamplerCfg::default(),
+        tail: TailCfg::default(),
+        queue: QueueCfg::default(),
+        budget: BudgetCfg::default(),
+    })
 }
 
 pub fn ftr_set_max_spans_per_trace(cfg: ftr_coll_cfg, mspt: usize) -> ftr_coll_cfg {
-    unsafe { transmute(transmute::<ftr_coll_cfg, Config>(cfg).max_spans_per_trace(Some(mspt))) }
+    let mut cfg = coll_cfg(cfg);
+    cfg.config = cfg.config.max_spans_per_trace(Some(mspt));
+    coll_cfg_raw(cfg)
+}
+
+pub fn ftr_set_max_bytes_per_trace(cfg: ftr_coll_cfg, n: usize) -> ftr_coll_cfg {
+    let mut cfg = coll_cfg(cfg);
+    cfg.budget.set_max_trace_bytes(n);
+    coll_cfg_raw(cfg)
 }
 
 pub fn ftr_set_report_interval(cfg: ftr_coll_cfg, ri: u64) -> ftr_coll_cfg {
-    unsafe {
-        transmute(transmute::<ftr_coll_cfg, Config>(cfg).report_interval(Duration::from_millis(ri)))
+    let mut cfg = coll_cfg(cfg);
+    cfg.config = cfg.config.report_interval(Duration::from_millis(ri));
+    coll_cfg_raw(cfg)
+}
+
+pub fn ftr_set_sample_ratio(cfg: ftr_coll_cfg, ratio: f64) -> ftr_coll_cfg {
+    let mut cfg = coll_cfg(cfg);
+    cfg.sampler.set_ratio(ratio);
+    coll_cfg_raw(cfg)
+}
+
+pub fn ftr_set_sample_rate_limit(cfg: ftr_coll_cfg, per_sec: f64, burst: u64) -> ftr_coll_cfg {
+    let mut cfg = coll_cfg(cfg);
+    cfg.sampler.set_rate_limit(per_sec, burst);
+    coll_cfg_raw(cfg)
+}
+
+pub fn ftr_set_root_sample_ratio(cfg: ftr_coll_cfg, name: &str, ratio: f64) -> ftr_coll_cfg {
+    let mut cfg = coll_cfg(cfg);
+    cfg.sampler.set_root_ratio(intern(name), ratio);
+    coll_cfg_raw(cfg)
+}
+
+pub fn ftr_set_root_sample_rate_limit(
+    cfg: ftr_coll_cfg,
+    name: &str,
+    per_sec: f64,
+    burst: u64,
+) -> ftr_coll_cfg {
+    let mut cfg = coll_cfg(cfg);
+    cfg.sampler
+        .set_root_rate_limit(intern(name), per_sec, burst);
+    coll_cfg_raw(cfg)
+}
+
+pub fn ftr_set_tail_min_duration(cfg: ftr_coll_cfg, ns: u64) -> ftr_coll_cfg {
+    let mut cfg = coll_cfg(cfg);
+    cfg.tail.set_min_duration(ns);
+    coll_cfg_raw(cfg)
+}
+
+pub fn ftr_set_tail_percentile(cfg: ftr_coll_cfg, percentile: f64) -> ftr_coll_cfg {
+    let mut cfg = coll_cfg(cfg);
+    cfg.tail.set_percentile(percentile);
+    coll_cfg_raw(cfg)
+}
+
+pub fn ftr_set_tail_error_prop(cfg: ftr_coll_cfg, key: &str) -> ftr_coll_cfg {
+    let mut cfg = coll_cfg(cfg);
+    cfg.tail.set_error_key(intern(key));
+    coll_cfg_raw(cfg)
+}
+
+pub fn ftr_set_queue_max_spans(cfg: ftr_coll_cfg, n: usize) -> ftr_coll_cfg {
+    let mut cfg = coll_cfg(cfg);
+    cfg.queue.set_max_spans(n);
+    coll_cfg_raw(cfg)
+}
+
+pub fn ftr_set_queue_max_bytes(cfg: ftr_coll_cfg, n: usize) -> ftr_coll_cfg {
+    let mut cfg = coll_cfg(cfg);
+    cfg.queue.set_max_bytes(n);
+    coll_cfg_raw(cfg)
+}
+
+pub fn ftr_set_queue_overflow(cfg: ftr_coll_cfg, policy: u32) -> ftr_coll_cfg {
+    let mut cfg = coll_cfg(cfg);
+    cfg.queue.set_policy(policy as u64);
+    coll_cfg_raw(cfg)
+}
+
+pub fn ftr_get_collector_stats() -> ftr_collector_stats {
+    stats::collector_stats()
+}
+
+/// Must match `ftr_clock_source`.
+const CLOCK_TSC: u32 = 0;
+const CLOCK_MONOTONIC_COARSE: u32 = 1;
+
+pub fn ftr_get_clock_source() -> u32 {
+    // fastrace times spans with minstant, which falls back to the coarse clock
+    // when the TSC is unusable.
+    if minstant::is_tsc_available() {
+        CLOCK_TSC
+    } else {
+        CLOCK_MONOTONIC_COARSE
     }
 }
 
 pub fn ftr_set_cons_rptr() {
-    fastrace::set_reporter(ConsoleReporter, Config::default())
+    set_reporter(ConsoleReporter, ftr_create_def_coll_cfg())
+}
+
+pub fn ftr_set_ring_rptr(dir: &str, file_bytes: usize, files: usize, cfg: ftr_coll_cfg) -> bool {
+    match RingReporter::open(dir.as_ref(), file_bytes, files) {
+        Ok(reporter) => {
+            set_reporter(reporter, cfg);
+            true
+        }
+        Err(_) => false,
+    }
+}
+
+pub fn ftr_set_custom_rptr(report: usize, drop: usize, user_data: usize, cfg: ftr_coll_cfg) {
+    let report = unsafe { transmute::<usize, custom::ReportFn>(report) };
+    let drop = (drop != 0).then(|| unsafe { transmute::<usize, custom::DropFn>(drop) });
+    set_reporter(
+        CustomReporter::new(report, drop, user_data as *mut c_void),
+        cfg,
+    )
+}
+
+pub fn ftr_set_columnar_rptr(report: usize, drop: usize, user_data: usize, cfg: ftr_coll_cfg) {
+    let report = unsafe { transmute::<usize, custom::ReportColumnsFn>(report) };
+    let drop = (drop != 0).then(|| unsafe { transmute::<usize, custom::DropFn>(drop) });
+    set_reporter(
+        ColumnarReporter::new(report, drop, user_data as *mut c_void),
+        cfg,
+    )
 }
 
 pub fn ftr_create_def_otlp_exp_cfg() -> ftr_otlp_exp_cfg {
-    unsafe {
-        transmute(opentelemetry_otlp::ExportConfig {
+    otlp_cfg_raw(OtlpCfg {
+        export: opentelemetry_otlp::ExportConfig {
             endpoint: std::env::var("OTEL_EXPORTER_OTLP_ENDPOINT")
                 .unwrap_or("http://127.0.0.1:4317".to_string()),
             protocol: opentelemetry_otlp::Protocol::Grpc,
             timeout: std::time::Duration::from_secs(
                 opentelemetry_otlp::OTEL_EXPORTER_OTLP_TIMEOUT_DEFAULT,
             ),
-        })
-    }
+        },
+        runtime: RuntimeCfg::default(),
+        transport: TransportCfg::default(),
+    })
+}
+
+pub fn ftr_set_otlp_rt_workers(cfg: ftr_otlp_exp_cfg, n: usize) -> ftr_otlp_exp_cfg {
+    let mut cfg = otlp_cfg(cfg);
+    cfg.runtime.set_worker_threads(n);
+    otlp_cfg_raw(cfg)
+}
+
+pub fn ftr_set_otlp_rt_cpus(cfg: ftr_otlp_exp_cfg, cpus: &[u32]) -> ftr_otlp_exp_cfg {
+    let mut cfg = otlp_cfg(cfg);
+    cfg.runtime.set_cpus(cpus);
+    otlp_cfg_raw(cfg)
+}
+
+pub fn ftr_set_otlp_rt_cur_thread(cfg: ftr_otlp_exp_cfg) -> ftr_otlp_exp_cfg {
+    let mut cfg = otlp_cfg(cfg);
+    cfg.runtime.set_current_thread();
+    otlp_cfg_raw(cfg)
+}
+
+pub fn ftr_set_otlp_rt_spawner(
+    cfg: ftr_otlp_exp_cfg,
+    spawn: usize,
+    user_data: usize,
+) -> ftr_otlp_exp_cfg {
+    let mut cfg = otlp_cfg(cfg);
+    cfg.runtime.set_spawner(spawn, user_data);
+    otlp_cfg_raw(cfg)
+}
+
+pub fn ftr_set_otlp_protocol(cfg: ftr_otlp_exp_cfg, protocol: u32) -> ftr_otlp_exp_cfg {
+    let mut cfg = otlp_cfg(cfg);
+    otlp::set_protocol(&mut cfg.export, protocol);
+    otlp_cfg_raw(cfg)
+}
+
+pub fn ftr_set_otlp_endpoint(cfg: ftr_otlp_exp_cfg, endpoint: &str) -> ftr_otlp_exp_cfg {
+    let mut cfg = otlp_cfg(cfg);
+    cfg.transport.set_endpoint(intern(endpoint));
+    otlp_cfg_raw(cfg)
+}
+
+pub fn ftr_set_otlp_compression(cfg: ftr_otlp_exp_cfg, compression: u32) -> ftr_otlp_exp_cfg {
+    let mut cfg = otlp_cfg(cfg);
+    cfg.transport.set_compression(compression as u64);
+    otlp_cfg_raw(cfg)
+}
+
+pub fn ftr_add_otlp_header(cfg: ftr_otlp_exp_cfg, key: &str, val: &str) -> ftr_otlp_exp_cfg {
+    let mut cfg = otlp_cfg(cfg);
+    cfg.transport.add_header(intern(key), intern(val));
+    otlp_cfg_raw(cfg)
+}
+
+pub fn ftr_set_otlp_timeout(cfg: ftr_otlp_exp_cfg, ms: u64) -> ftr_otlp_exp_cfg {
+    let mut cfg = otlp_cfg(cfg);
+    otlp::set_timeout(&mut cfg.export, ms);
+    otlp_cfg_raw(cfg)
+}
+
+pub fn ftr_set_otlp_max_batch_bytes(cfg: ftr_otlp_exp_cfg, n: usize) -> ftr_otlp_exp_cfg {
+    let mut cfg = otlp_cfg(cfg);
+    cfg.transport.set_max_batch_bytes(n);
+    otlp_cfg_raw(cfg)
 }
 
 pub fn ftr_create_otel_rptr(cfg: ftr_otlp_exp_cfg) -> ftr_otel_rptr {
-    initialize_runtime();
-
-    let reporter = RUNTIME.lock().unwrap().block_on(async {
-        fastrace_opentelemetry::OpenTelemetryReporter::new(
-            opentelemetry_otlp::new_exporter()
-                .tonic()
-                .with_export_config(unsafe { transmute(cfg) })
-                .build_span_exporter()
-                .expect("initialize oltp exporter"),
-            opentelemetry::trace::SpanKind::Server,
-            Cow::Owned(opentelemetry_sdk::Resource::new([
-                opentelemetry::KeyValue::new(
-                    "service.name",
-                    std::env::var("SERVICE_NAME").unwrap_or("unknown".to_string()),
-                ),
-            ])),
-            opentelemetry::InstrumentationLibrary::builder("libfastrace")
-                .with_version(env!("CARGO_PKG_VERSION"))
-                .build(),
-        )
-    });
+    let cfg = otlp_cfg(cfg);
+
+    let reporter = fastrace_opentelemetry::OpenTelemetryReporter::new(
+        otlp::build(cfg.export, &cfg.transport, runtime::handle(&cfg.runtime))
+            .expect("initialize oltp exporter"),
+        opentelemetry::trace::SpanKind::Server,
+        Cow::Owned(opentelemetry_sdk::Resource::new([
+            opentelemetry::KeyValue::new(
+                "service.name",
+                std::env::var("SERVICE_NAME").unwrap_or("unknown".to_string()),
+            ),
+        ])),
+        opentelemetry::InstrumentationLibrary::builder("libfastrace")
+            .with_version(env!("CARGO_PKG_VERSION"))
+            .build(),
+    );
 
-    unsafe { transmute(reporter) }
+    unsafe {
+        transmute(OtelRptr {
+            reporter,
+            max_batch_bytes: cfg.transport.max_batch_bytes(),
+        })
+    }
 }
 
 pub fn ftr_destroy_otel_rptr(rptr: ftr_otel_rptr) {
     unsafe {
-        drop(transmute::<ftr_otel_rptr, OpenTelemetryReporter>(rptr));
+        drop(transmute::<ftr_otel_rptr, OtelRptr>(rptr));
     }
 }
 
 pub fn ftr_set_otel_rptr(rptr: ftr_otel_rptr, cfg: ftr_coll_cfg) {
-    unsafe {
-        fastrace::set_reporter(
-            transmute::<ftr_otel_rptr, OpenTelemetryReporter>(rptr),
-            transmute(cfg),
-        )
+    let rptr = unsafe { transmute::<ftr_otel_rptr, OtelRptr>(rptr) };
+    if rptr.max_batch_bytes > 0 {
+        set_reporter(Chunked::new(rptr.reporter, rptr.max_batch_bytes), cfg)
+    } else {
+        set_reporter(rptr.reporter, cfg)
     }
 }
 
 pub fn ftr_flush() {
-    fastrace::flush()
+    queue::flush();
+}
+
+type FlushFn = extern "C" fn(stats: ftr_flush_stats, user_data: *mut c_void);
+
+pub fn ftr_flush_async(cb: usize, user_data: usize) {
+    flush::flush_async(Box::new(move |stats| {
+        if cb != 0 {
+            let cb = unsafe { transmute::<usize, FlushFn>(cb) };
+            cb(stats, user_data as *mut c_void);
+        }
+    }))
+}
+
+pub fn ftr_flush_timeout(ms: u64, stats: &mut ftr_flush_stats) -> bool {
+    match flush::flush_timeout(Duration::from_millis(ms)) {
+        Some(done) => {
+            *stats = done;
+            true
+        }
+        None => false,
+    }
 }
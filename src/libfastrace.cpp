@@ -28,29 +28,41 @@ Type call_rust_function(Type (*rust_func)(Args...),
   return rust_func(std::forward<decltype(args)>(args)...);
 }
 
-template <typename T>
-T deref_or_self(const T* ptr) {
-  static const T default_value = T();
-  return ptr ? *ptr : default_value;
-}
+// Splits key-value pairs into the parallel arrays taken by the C API.
+struct PropArrays {
+  explicit PropArrays(
+      const std::vector<std::pair<const char*, const char*>>& properties) {
+    keys.reserve(properties.size());
+    vals.reserve(properties.size());
+    for (const auto& property : properties) {
+      keys.push_back(property.first);
+      vals.push_back(property.second);
+    }
+  }
+
+  std::vector<const char*> keys;
+  std::vector<const char*> vals;
+};
 
 }  // anonymous namespace
 
 extern "C" {
 
+__thread uint32_t ftr_loc_par_depth = 0;
+__thread const ftr_span* ftr_loc_par_hidden = nullptr;
+
 ftr_span_ctx ftr_create_rand_span_ctx() {
   return call_rust_function<ftr_span_ctx>(
       &fastrace_glue::ftr_create_rand_span_ctx);
 }
 
-ftr_span_ctx ftr_create_span_ctx(const ftr_span* span) {
-  ffi::ftr_span rust_span =
-      deref_or_self(reinterpret_cast<const ffi::ftr_span*>(span));
-  return call_rust_function<ftr_span_ctx>(&fastrace_glue::ftr_create_span_ctx,
-                                          rust_span);
+ftr_span_ctx ftr_create_span_ctx_impl(const ftr_span* span) {
+  return call_rust_function<ftr_span_ctx>(
+      &fastrace_glue::ftr_create_span_ctx,
+      reinterpret_cast<const ffi::ftr_span*>(span));
 }
 
-ftr_span_ctx ftr_create_span_ctx_loc() {
+ftr_span_ctx ftr_create_span_ctx_loc_impl() {
   return call_rust_function<ftr_span_ctx>(
       &fastrace_glue::ftr_create_span_ctx_loc);
 }
@@ -61,6 +73,37 @@ ftr_span_ctx ftr_span_ctx_set_sampled(ftr_span_ctx ctx, bool sampled) {
       *reinterpret_cast<ffi::ftr_span_ctx*>(&ctx), sampled);
 }
 
+size_t ftr_span_ctx_encode_w3c(ftr_span_ctx ctx, char* buf, size_t len) {
+  return fastrace_glue::ftr_span_ctx_encode_w3c(
+      *reinterpret_cast<ffi::ftr_span_ctx*>(&ctx),
+      rust::Slice<uint8_t>(reinterpret_cast<uint8_t*>(buf), len));
+}
+
+bool ftr_span_ctx_decode_w3c(const char* value, size_t len,
+                             ftr_span_ctx* ctx) {
+  return fastrace_glue::ftr_span_ctx_decode_w3c(
+      rust::Slice<const uint8_t>(reinterpret_cast<const uint8_t*>(value), len),
+      *reinterpret_cast<ffi::ftr_span_ctx*>(ctx));
+}
+
+size_t ftr_span_ctx_encode_bin(ftr_span_ctx ctx, uint8_t* buf, size_t len) {
+  return fastrace_glue::ftr_span_ctx_encode_bin(
+      *reinterpret_cast<ffi::ftr_span_ctx*>(&ctx),
+      rust::Slice<uint8_t>(buf, len));
+}
+
+bool ftr_span_ctx_decode_bin(const uint8_t* buf, size_t len,
+                             ftr_span_ctx* ctx) {
+  return fastrace_glue::ftr_span_ctx_decode_bin(
+      rust::Slice<const uint8_t>(buf, len),
+      *reinterpret_cast<ffi::ftr_span_ctx*>(ctx));
+}
+
+ftr_name_id ftr_register_name(const char* name) {
+  return call_rust_function<ftr_name_id>(&fastrace_glue::ftr_register_name,
+                                         rust::Str(name));
+}
+
 ftr_span ftr_create_root_span(const char* name, ftr_span_ctx parent) {
   const ffi::ftr_span_ctx& rust_parent =
       *reinterpret_cast<const ffi::ftr_span_ctx*>(&parent);
@@ -68,12 +111,11 @@ ftr_span ftr_create_root_span(const char* name, ftr_span_ctx parent) {
                                       rust::Str(name), rust_parent);
 }
 
-ftr_span ftr_create_child_span_enter(const char* name, const ftr_span* parent) {
-  ffi::ftr_span rust_parent =
-      deref_or_self(reinterpret_cast<const ffi::ftr_span*>(parent));
+ftr_span ftr_create_child_span_enter_impl(const char* name,
+                                          const ftr_span* parent) {
   return call_rust_function<ftr_span>(
       &fastrace_glue::ftr_create_child_span_enter, rust::Str(name),
-      rust_parent);
+      reinterpret_cast<const ffi::ftr_span*>(parent));
 }
 
 ftr_span ftr_create_child_span_enter_mul(const char* name,
@@ -84,54 +126,143 @@ ftr_span ftr_create_child_span_enter_mul(const char* name,
           reinterpret_cast<const ffi::ftr_span*>(parents), n));
 }
 
-ftr_span ftr_create_child_span_enter_loc(const char* name) {
+void ftr_create_child_spans_enter_batch_impl(const char* const* names, size_t n,
+                                             const ftr_span* parent,
+                                             ftr_span* out) {
+  fastrace_glue::ftr_create_child_spans_enter_batch(
+      rust::Slice<const char* const>(names, n),
+      reinterpret_cast<const ffi::ftr_span*>(parent),
+      rust::Slice<ffi::ftr_span>(reinterpret_cast<ffi::ftr_span*>(out), n));
+}
+
+ftr_span ftr_create_child_span_enter_loc_impl(const char* name) {
   return call_rust_function<ftr_span>(
       &fastrace_glue::ftr_create_child_span_enter_loc, rust::Str(name));
 }
 
-void ftr_cancel_span(ftr_span span) {
-  fastrace_glue::ftr_cancel_span(*reinterpret_cast<ffi::ftr_span*>(&span));
+ftr_span ftr_create_root_span_id(ftr_name_id name, ftr_span_ctx parent) {
+  return call_rust_function<ftr_span>(
+      &fastrace_glue::ftr_create_root_span_id,
+      *reinterpret_cast<ffi::ftr_name_id*>(&name),
+      *reinterpret_cast<ffi::ftr_span_ctx*>(&parent));
 }
 
-uint64_t ftr_span_elapsed(const ftr_span* span) {
+ftr_span ftr_create_child_span_enter_id_impl(ftr_name_id name,
+                                             const ftr_span* parent) {
+  return call_rust_function<ftr_span>(
+      &fastrace_glue::ftr_create_child_span_enter_id,
+      *reinterpret_cast<ffi::ftr_name_id*>(&name),
+      reinterpret_cast<const ffi::ftr_span*>(parent));
+}
+
+void ftr_create_child_spans_enter_batch_id_impl(const ftr_name_id* names,
+                                                size_t n,
+                                                const ftr_span* parent,
+                                                ftr_span* out) {
+  fastrace_glue::ftr_create_child_spans_enter_batch_id(
+      rust::Slice<const ffi::ftr_name_id>(
+          reinterpret_cast<const ffi::ftr_name_id*>(names), n),
+      reinterpret_cast<const ffi::ftr_span*>(parent),
+      rust::Slice<ffi::ftr_span>(reinterpret_cast<ffi::ftr_span*>(out), n));
+}
+
+ftr_span ftr_create_child_span_enter_mul_id(ftr_name_id name,
+                                            const ftr_span* parents,
+                                            size_t n) {
+  return call_rust_function<ftr_span>(
+      &fastrace_glue::ftr_create_child_span_enter_mul_id,
+      *reinterpret_cast<ffi::ftr_name_id*>(&name),
+      rust::Slice<const ffi::ftr_span>(
+          reinterpret_cast<const ffi::ftr_span*>(parents), n));
+}
+
+ftr_span ftr_create_child_span_enter_loc_id_impl(ftr_name_id name) {
+  return call_rust_function<ftr_span>(
+      &fastrace_glue::ftr_create_child_span_enter_loc_id,
+      *reinterpret_cast<ffi::ftr_name_id*>(&name));
+}
+
+void ftr_cancel_span_impl(ftr_span* span) {
+  fastrace_glue::ftr_cancel_span(reinterpret_cast<ffi::ftr_span*>(span));
+}
+
+uint64_t ftr_span_elapsed_impl(const ftr_span* span) {
   return fastrace_glue::ftr_span_elapsed(
-      *reinterpret_cast<const ffi::ftr_span*>(span));
+      reinterpret_cast<const ffi::ftr_span*>(span));
 }
 
-void ftr_destroy_span(ftr_span span) {
-  fastrace_glue::ftr_destroy_span(*reinterpret_cast<ffi::ftr_span*>(&span));
+void ftr_destroy_span_impl(ftr_span* span) {
+  fastrace_glue::ftr_destroy_span(reinterpret_cast<ffi::ftr_span*>(span));
 }
 
-ftr_loc_par_guar ftr_set_loc_par_to_span(const ftr_span* span) {
-  ffi::ftr_span rust_span =
-      deref_or_self(reinterpret_cast<const ffi::ftr_span*>(span));
+ftr_loc_par_guar ftr_set_loc_par_to_span_impl(const ftr_span* span) {
+  ++ftr_loc_par_depth;
   return call_rust_function<ftr_loc_par_guar>(
-      &fastrace_glue::ftr_set_loc_par_to_span, rust_span);
+      &fastrace_glue::ftr_set_loc_par_to_span,
+      reinterpret_cast<const ffi::ftr_span*>(span));
 }
 
-void ftr_span_with_prop(ftr_span* span, const char* key, const char* val) {
+void ftr_span_with_prop_impl(ftr_span* span, const char* key, const char* val) {
   fastrace_glue::ftr_span_with_prop(*reinterpret_cast<ffi::ftr_span*>(span),
                                     rust::Str(key), rust::Str(val));
 }
 
-void ftr_span_with_props(ftr_span* span, const char** keys, const char** vals,
-                         size_t n) {
+void ftr_span_with_props_impl(ftr_span* span, const char** keys,
+                              const char** vals, size_t n) {
   fastrace_glue::ftr_span_with_props(*reinterpret_cast<ffi::ftr_span*>(span),
                                      rust::Slice<const char* const>(keys, n),
                                      rust::Slice<const char* const>(vals, n));
 }
 
-void ftr_add_ent_to_par(const char* name, ftr_span* span, const char** keys,
-                        const char** vals, size_t n) {
+void ftr_span_with_prop_i64_impl(ftr_span* span, const char* key, int64_t val) {
+  fastrace_glue::ftr_span_with_prop_i64(*reinterpret_cast<ffi::ftr_span*>(span),
+                                        rust::Str(key), val);
+}
+
+void ftr_span_with_prop_u64_impl(ftr_span* span, const char* key,
+                                 uint64_t val) {
+  fastrace_glue::ftr_span_with_prop_u64(*reinterpret_cast<ffi::ftr_span*>(span),
+                                        rust::Str(key), val);
+}
+
+void ftr_span_with_prop_f64_impl(ftr_span* span, const char* key, double val) {
+  fastrace_glue::ftr_span_with_prop_f64(*reinterpret_cast<ffi::ftr_span*>(span),
+                                        rust::Str(key), val);
+}
+
+void ftr_span_with_prop_bool_impl(ftr_span* span, const char* key, bool val) {
+  fastrace_glue::ftr_span_with_prop_bool(
+      *reinterpret_cast<ffi::ftr_span*>(span), rust::Str(key), val);
+}
+
+void ftr_span_with_props_ex_impl(ftr_span* span, const ftr_prop* props,
+                                 size_t n) {
+  fastrace_glue::ftr_span_with_props_ex(
+      *reinterpret_cast<ffi::ftr_span*>(span),
+      rust::Slice<const ffi::ftr_prop>(
+          reinterpret_cast<const ffi::ftr_prop*>(props), n));
+}
+
+void ftr_add_ent_to_par_impl(const char* name, ftr_span* span,
+                             const char** keys, const char** vals, size_t n) {
   fastrace_glue::ftr_add_ent_to_par(rust::Str(name),
                                     *reinterpret_cast<ffi::ftr_span*>(span),
                                     rust::Slice<const char* const>(keys, n),
                                     rust::Slice<const char* const>(vals, n));
 }
 
-void ftr_destroy_loc_par_guar(ftr_loc_par_guar guard) {
+void ftr_add_ent_to_par_ex_impl(const char* name, ftr_span* span,
+                                const ftr_prop* props, size_t n) {
+  fastrace_glue::ftr_add_ent_to_par_ex(
+      rust::Str(name), *reinterpret_cast<ffi::ftr_span*>(span),
+      rust::Slice<const ffi::ftr_prop>(
+          reinterpret_cast<const ffi::ftr_prop*>(props), n));
+}
+
+void ftr_destroy_loc_par_guar_impl(ftr_loc_par_guar* guard) {
+  --ftr_loc_par_depth;
   fastrace_glue::ftr_destroy_loc_par_guar(
-      *reinterpret_cast<ffi::ftr_loc_par_guar*>(&guard));
+      *reinterpret_cast<ffi::ftr_loc_par_guar*>(guard));
 }
 
 void ftr_push_child_spans_to_cur(const ftr_span* span,
@@ -141,53 +272,130 @@ void ftr_push_child_spans_to_cur(const ftr_span* span,
       *reinterpret_cast<ffi::ftr_loc_spans*>(&local_span));
 }
 
-ftr_loc_span ftr_create_loc_span_enter(const char* name) {
+void ftr_create_child_spans_at_impl(const ftr_span* parent,
+                                    const ftr_timed_span* spans, size_t n) {
+  fastrace_glue::ftr_create_child_spans_at(
+      *reinterpret_cast<const ffi::ftr_span*>(parent),
+      rust::Slice<const ffi::ftr_timed_span>(
+          reinterpret_cast<const ffi::ftr_timed_span*>(spans), n));
+}
+
+ftr_loc_span ftr_create_loc_span_enter_impl(const char* name) {
   return call_rust_function<ftr_loc_span>(
       &fastrace_glue::ftr_create_loc_span_enter, rust::Str(name));
 }
 
-void ftr_loc_span_add_prop(const char* key, const char* val) {
+ftr_loc_span ftr_create_loc_span_enter_id_impl(ftr_name_id name) {
+  return call_rust_function<ftr_loc_span>(
+      &fastrace_glue::ftr_create_loc_span_enter_id,
+      *reinterpret_cast<ffi::ftr_name_id*>(&name));
+}
+
+void ftr_loc_span_add_prop_impl(const char* key, const char* val) {
   fastrace_glue::ftr_loc_span_add_prop(rust::Str(key), rust::Str(val));
 }
 
-void ftr_loc_span_add_props(const char** keys, const char** vals, size_t n) {
+void ftr_loc_span_add_prop_i64_impl(const char* key, int64_t val) {
+  fastrace_glue::ftr_loc_span_add_prop_i64(rust::Str(key), val);
+}
+
+void ftr_loc_span_add_prop_u64_impl(const char* key, uint64_t val) {
+  fastrace_glue::ftr_loc_span_add_prop_u64(rust::Str(key), val);
+}
+
+void ftr_loc_span_add_prop_f64_impl(const char* key, double val) {
+  fastrace_glue::ftr_loc_span_add_prop_f64(rust::Str(key), val);
+}
+
+void ftr_loc_span_add_prop_bool_impl(const char* key, bool val) {
+  fastrace_glue::ftr_loc_span_add_prop_bool(rust::Str(key), val);
+}
+
+void ftr_loc_span_add_props_impl(const char** keys, const char** vals,
+                                 size_t n) {
   fastrace_glue::ftr_loc_span_add_props(
       rust::Slice<const char* const>(keys, n),
       rust::Slice<const char* const>(vals, n));
 }
 
-void ftr_loc_span_with_prop(ftr_loc_span* span, const char* key,
-                            const char* val) {
+void ftr_loc_span_add_props_ex_impl(const ftr_prop* props, size_t n) {
+  fastrace_glue::ftr_loc_span_add_props_ex(rust::Slice<const ffi::ftr_prop>(
+      reinterpret_cast<const ffi::ftr_prop*>(props), n));
+}
+
+void ftr_loc_span_with_prop_impl(ftr_loc_span* span, const char* key,
+                                 const char* val) {
   fastrace_glue::ftr_loc_span_with_prop(
       *reinterpret_cast<ffi::ftr_loc_span*>(span), rust::Str(key),
       rust::Str(val));
 }
 
-void ftr_loc_span_with_props(ftr_loc_span* span, const char** keys,
-                             const char** vals, size_t n) {
+void ftr_loc_span_with_prop_i64_impl(ftr_loc_span* span, const char* key,
+                                     int64_t val) {
+  fastrace_glue::ftr_loc_span_with_prop_i64(
+      *reinterpret_cast<ffi::ftr_loc_span*>(span), rust::Str(key), val);
+}
+
+void ftr_loc_span_with_prop_u64_impl(ftr_loc_span* span, const char* key,
+                                     uint64_t val) {
+  fastrace_glue::ftr_loc_span_with_prop_u64(
+      *reinterpret_cast<ffi::ftr_loc_span*>(span), rust::Str(key), val);
+}
+
+void ftr_loc_span_with_prop_f64_impl(ftr_loc_span* span, const char* key,
+                                     double val) {
+  fastrace_glue::ftr_loc_span_with_prop_f64(
+      *reinterpret_cast<ffi::ftr_loc_span*>(span), rust::Str(key), val);
+}
+
+void ftr_loc_span_with_prop_bool_impl(ftr_loc_span* span, const char* key,
+                                      bool val) {
+  fastrace_glue::ftr_loc_span_with_prop_bool(
+      *reinterpret_cast<ffi::ftr_loc_span*>(span), rust::Str(key), val);
+}
+
+void ftr_loc_span_with_props_impl(ftr_loc_span* span, const char** keys,
+                                  const char** vals, size_t n) {
   fastrace_glue::ftr_loc_span_with_props(
       *reinterpret_cast<ffi::ftr_loc_span*>(span),
       rust::Slice<const char* const>(keys, n),
       rust::Slice<const char* const>(vals, n));
 }
 
-void ftr_add_ent_to_loc_par(const char* name, const char** keys,
-                            const char** vals, size_t n) {
+void ftr_loc_span_with_props_ex_impl(ftr_loc_span* span, const ftr_prop* props,
+                                     size_t n) {
+  fastrace_glue::ftr_loc_span_with_props_ex(
+      *reinterpret_cast<ffi::ftr_loc_span*>(span),
+      rust::Slice<const ffi::ftr_prop>(
+          reinterpret_cast<const ffi::ftr_prop*>(props), n));
+}
+
+void ftr_add_ent_to_loc_par_impl(const char* name, const char** keys,
+                                 const char** vals, size_t n) {
   fastrace_glue::ftr_add_ent_to_loc_par(
       rust::Str(name), rust::Slice<const char* const>(keys, n),
       rust::Slice<const char* const>(vals, n));
 }
 
-void ftr_destroy_loc_span(ftr_loc_span span) {
+void ftr_add_ent_to_loc_par_ex_impl(const char* name, const ftr_prop* props,
+                                    size_t n) {
+  fastrace_glue::ftr_add_ent_to_loc_par_ex(
+      rust::Str(name), rust::Slice<const ffi::ftr_prop>(
+                           reinterpret_cast<const ffi::ftr_prop*>(props), n));
+}
+
+void ftr_destroy_loc_span_impl(ftr_loc_span* span) {
   fastrace_glue::ftr_destroy_loc_span(
-      *reinterpret_cast<ffi::ftr_loc_span*>(&span));
+      reinterpret_cast<ffi::ftr_loc_span*>(span));
 }
 
 ftr_loc_coll ftr_start_loc_coll() {
+  ++ftr_loc_par_depth;
   return call_rust_function<ftr_loc_coll>(&fastrace_glue::ftr_start_loc_coll);
 }
 
 ftr_loc_spans ftr_collect_loc_spans(ftr_loc_coll lc) {
+  --ftr_loc_par_depth;
   return call_rust_function<ftr_loc_spans>(
       &fastrace_glue::ftr_collect_loc_spans,
       *reinterpret_cast<ffi::ftr_loc_coll*>(&lc));
@@ -204,19 +412,193 @@ ftr_coll_cfg ftr_set_max_spans_per_trace(ftr_coll_cfg cfg, size_t max) {
       *reinterpret_cast<ffi::ftr_coll_cfg*>(&cfg), max);
 }
 
+ftr_coll_cfg ftr_set_max_bytes_per_trace(ftr_coll_cfg cfg, size_t n) {
+  return call_rust_function<ftr_coll_cfg>(
+      &fastrace_glue::ftr_set_max_bytes_per_trace,
+      *reinterpret_cast<ffi::ftr_coll_cfg*>(&cfg), n);
+}
+
 ftr_coll_cfg ftr_set_report_interval(ftr_coll_cfg cfg, uint64_t ri) {
   return call_rust_function<ftr_coll_cfg>(
       &fastrace_glue::ftr_set_report_interval,
       *reinterpret_cast<ffi::ftr_coll_cfg*>(&cfg), ri);
 }
 
+ftr_coll_cfg ftr_set_sample_ratio(ftr_coll_cfg cfg, double ratio) {
+  return call_rust_function<ftr_coll_cfg>(
+      &fastrace_glue::ftr_set_sample_ratio,
+      *reinterpret_cast<ffi::ftr_coll_cfg*>(&cfg), ratio);
+}
+
+ftr_coll_cfg ftr_set_sample_rate_limit(ftr_coll_cfg cfg, double per_sec,
+                                       uint64_t burst) {
+  return call_rust_function<ftr_coll_cfg>(
+      &fastrace_glue::ftr_set_sample_rate_limit,
+      *reinterpret_cast<ffi::ftr_coll_cfg*>(&cfg), per_sec, burst);
+}
+
+ftr_coll_cfg ftr_set_root_sample_ratio(ftr_coll_cfg cfg, const char* name,
+                                       double ratio) {
+  return call_rust_function<ftr_coll_cfg>(
+      &fastrace_glue::ftr_set_root_sample_ratio,
+      *reinterpret_cast<ffi::ftr_coll_cfg*>(&cfg), rust::Str(name), ratio);
+}
+
+ftr_coll_cfg ftr_set_root_sample_rate_limit(ftr_coll_cfg cfg, const char* name,
+                                            double per_sec, uint64_t burst) {
+  return call_rust_function<ftr_coll_cfg>(
+      &fastrace_glue::ftr_set_root_sample_rate_limit,
+      *reinterpret_cast<ffi::ftr_coll_cfg*>(&cfg), rust::Str(name), per_sec,
+      burst);
+}
+
+ftr_coll_cfg ftr_set_tail_min_duration(ftr_coll_cfg cfg, uint64_t ns) {
+  return call_rust_function<ftr_coll_cfg>(
+      &fastrace_glue::ftr_set_tail_min_duration,
+      *reinterpret_cast<ffi::ftr_coll_cfg*>(&cfg), ns);
+}
+
+ftr_coll_cfg ftr_set_tail_percentile(ftr_coll_cfg cfg, double percentile) {
+  return call_rust_function<ftr_coll_cfg>(
+      &fastrace_glue::ftr_set_tail_percentile,
+      *reinterpret_cast<ffi::ftr_coll_cfg*>(&cfg), percentile);
+}
+
+ftr_coll_cfg ftr_set_tail_error_prop(ftr_coll_cfg cfg, const char* key) {
+  return call_rust_function<ftr_coll_cfg>(
+      &fastrace_glue::ftr_set_tail_error_prop,
+      *reinterpret_cast<ffi::ftr_coll_cfg*>(&cfg), rust::Str(key));
+}
+
+ftr_coll_cfg ftr_set_queue_max_spans(ftr_coll_cfg cfg, size_t n) {
+  return call_rust_function<ftr_coll_cfg>(
+      &fastrace_glue::ftr_set_queue_max_spans,
+      *reinterpret_cast<ffi::ftr_coll_cfg*>(&cfg), n);
+}
+
+ftr_coll_cfg ftr_set_queue_max_bytes(ftr_coll_cfg cfg, size_t n) {
+  return call_rust_function<ftr_coll_cfg>(
+      &fastrace_glue::ftr_set_queue_max_bytes,
+      *reinterpret_cast<ffi::ftr_coll_cfg*>(&cfg), n);
+}
+
+ftr_coll_cfg ftr_set_queue_overflow(ftr_coll_cfg cfg, ftr_overflow policy) {
+  return call_rust_function<ftr_coll_cfg>(
+      &fastrace_glue::ftr_set_queue_overflow,
+      *reinterpret_cast<ffi::ftr_coll_cfg*>(&cfg),
+      static_cast<uint32_t>(policy));
+}
+
+ftr_collector_stats ftr_get_collector_stats() {
+  return call_rust_function<ftr_collector_stats>(
+      &fastrace_glue::ftr_get_collector_stats);
+}
+
+ftr_clock_source ftr_get_clock_source() {
+  return static_cast<ftr_clock_source>(fastrace_glue::ftr_get_clock_source());
+}
+
 void ftr_set_cons_rptr() { fastrace_glue::ftr_set_cons_rptr(); }
 
+bool ftr_set_ring_rptr(const char* dir, size_t file_bytes, size_t files,
+                       ftr_coll_cfg cfg) {
+  return fastrace_glue::ftr_set_ring_rptr(
+      rust::Str(dir), file_bytes, files,
+      *reinterpret_cast<ffi::ftr_coll_cfg*>(&cfg));
+}
+
+void ftr_set_custom_rptr(ftr_report_fn report, void* user_data,
+                         ftr_coll_cfg cfg) {
+  fastrace_glue::ftr_set_custom_rptr(
+      reinterpret_cast<size_t>(report), 0, reinterpret_cast<size_t>(user_data),
+      *reinterpret_cast<ffi::ftr_coll_cfg*>(&cfg));
+}
+
+void ftr_set_columnar_rptr(ftr_report_columns_fn report, void* user_data,
+                           ftr_coll_cfg cfg) {
+  fastrace_glue::ftr_set_columnar_rptr(
+      reinterpret_cast<size_t>(report), 0, reinterpret_cast<size_t>(user_data),
+      *reinterpret_cast<ffi::ftr_coll_cfg*>(&cfg));
+}
+
 ftr_otlp_exp_cfg ftr_create_def_otlp_exp_cfg() {
   return call_rust_function<ftr_otlp_exp_cfg>(
       &fastrace_glue::ftr_create_def_otlp_exp_cfg);
 }
 
+ftr_otlp_exp_cfg ftr_set_otlp_rt_workers(ftr_otlp_exp_cfg cfg, size_t n) {
+  return call_rust_function<ftr_otlp_exp_cfg>(
+      &fastrace_glue::ftr_set_otlp_rt_workers,
+      *reinterpret_cast<ffi::ftr_otlp_exp_cfg*>(&cfg), n);
+}
+
+ftr_otlp_exp_cfg ftr_set_otlp_rt_cpus(ftr_otlp_exp_cfg cfg,
+                                      const uint32_t* cpus, size_t n) {
+  return call_rust_function<ftr_otlp_exp_cfg>(
+      &fastrace_glue::ftr_set_otlp_rt_cpus,
+      *reinterpret_cast<ffi::ftr_otlp_exp_cfg*>(&cfg),
+      rust::Slice<const uint32_t>(cpus, n));
+}
+
+ftr_otlp_exp_cfg ftr_set_otlp_rt_cur_thread(ftr_otlp_exp_cfg cfg) {
+  return call_rust_function<ftr_otlp_exp_cfg>(
+      &fastrace_glue::ftr_set_otlp_rt_cur_thread,
+      *reinterpret_cast<ffi::ftr_otlp_exp_cfg*>(&cfg));
+}
+
+ftr_otlp_exp_cfg ftr_set_otlp_rt_spawner(ftr_otlp_exp_cfg cfg,
+                                         ftr_rt_spawn_fn spawn,
+                                         void* user_data) {
+  return call_rust_function<ftr_otlp_exp_cfg>(
+      &fastrace_glue::ftr_set_otlp_rt_spawner,
+      *reinterpret_cast<ffi::ftr_otlp_exp_cfg*>(&cfg),
+      reinterpret_cast<size_t>(spawn), reinterpret_cast<size_t>(user_data));
+}
+
+ftr_otlp_exp_cfg ftr_set_otlp_protocol(ftr_otlp_exp_cfg cfg,
+                                       ftr_otlp_protocol protocol) {
+  return call_rust_function<ftr_otlp_exp_cfg>(
+      &fastrace_glue::ftr_set_otlp_protocol,
+      *reinterpret_cast<ffi::ftr_otlp_exp_cfg*>(&cfg),
+      static_cast<uint32_t>(protocol));
+}
+
+ftr_otlp_exp_cfg ftr_set_otlp_endpoint(ftr_otlp_exp_cfg cfg,
+                                       const char* endpoint) {
+  return call_rust_function<ftr_otlp_exp_cfg>(
+      &fastrace_glue::ftr_set_otlp_endpoint,
+      *reinterpret_cast<ffi::ftr_otlp_exp_cfg*>(&cfg), rust::Str(endpoint));
+}
+
+ftr_otlp_exp_cfg ftr_set_otlp_compression(ftr_otlp_exp_cfg cfg,
+                                          ftr_otlp_compression compression) {
+  return call_rust_function<ftr_otlp_exp_cfg>(
+      &fastrace_glue::ftr_set_otlp_compression,
+      *reinterpret_cast<ffi::ftr_otlp_exp_cfg*>(&cfg),
+      static_cast<uint32_t>(compression));
+}
+
+ftr_otlp_exp_cfg ftr_add_otlp_header(ftr_otlp_exp_cfg cfg, const char* key,
+                                     const char* val) {
+  return call_rust_function<ftr_otlp_exp_cfg>(
+      &fastrace_glue::ftr_add_otlp_header,
+      *reinterpret_cast<ffi::ftr_otlp_exp_cfg*>(&cfg), rust::Str(key),
+      rust::Str(val));
+}
+
+ftr_otlp_exp_cfg ftr_set_otlp_timeout(ftr_otlp_exp_cfg cfg, uint64_t ms) {
+  return call_rust_function<ftr_otlp_exp_cfg>(
+      &fastrace_glue::ftr_set_otlp_timeout,
+      *reinterpret_cast<ffi::ftr_otlp_exp_cfg*>(&cfg), ms);
+}
+
+ftr_otlp_exp_cfg ftr_set_otlp_max_batch_bytes(ftr_otlp_exp_cfg cfg,
+                                              size_t n) {
+  return call_rust_function<ftr_otlp_exp_cfg>(
+      &fastrace_glue::ftr_set_otlp_max_batch_bytes,
+      *reinterpret_cast<ffi::ftr_otlp_exp_cfg*>(&cfg), n);
+}
+
 ftr_otel_rptr ftr_create_otel_rptr(ftr_otlp_exp_cfg cfg) {
   return call_rust_function<ftr_otel_rptr>(
       &fastrace_glue::ftr_create_otel_rptr,
@@ -236,6 +618,21 @@ void ftr_set_otel_rptr(ftr_otel_rptr rptr, ftr_coll_cfg cfg) {
 
 void ftr_flush() { fastrace_glue::ftr_flush(); }
 
+void ftr_flush_async(ftr_flush_cb cb, void* user_data) {
+  fastrace_glue::ftr_flush_async(reinterpret_cast<size_t>(cb),
+                                 reinterpret_cast<size_t>(user_data));
+}
+
+bool ftr_flush_timeout(uint64_t ms, ftr_flush_stats* stats) {
+  ftr_flush_stats done = {0, 0, 0};
+  if (!fastrace_glue::ftr_flush_timeout(
+          ms, *reinterpret_cast<ffi::ftr_flush_stats*>(&done))) {
+    return false;
+  }
+  if (stats) *stats = done;
+  return true;
+}
+
 }  // extern "C"
 
 namespace fastrace {
@@ -250,6 +647,33 @@ void SpanContext::setSampled(bool sampled) {
   ctx_ = ftr_span_ctx_set_sampled(ctx_, sampled);
 }
 
+size_t SpanContext::toTraceparent(char* buf, size_t len) const {
+  return ftr_span_ctx_encode_w3c(ctx_, buf, len);
+}
+
+std::string SpanContext::toTraceparent() const {
+  char buf[FTR_TRACEPARENT_LEN];
+  return std::string(buf, ftr_span_ctx_encode_w3c(ctx_, buf, sizeof(buf)));
+}
+
+bool SpanContext::fromTraceparent(const char* value, size_t len,
+                                  SpanContext& ctx) {
+  return ftr_span_ctx_decode_w3c(value, len, &ctx.ctx_);
+}
+
+size_t SpanContext::serializeBinary(uint8_t* buf, size_t len) const {
+  return ftr_span_ctx_encode_bin(ctx_, buf, len);
+}
+
+bool SpanContext::deserializeBinary(const uint8_t* buf, size_t len,
+                                    SpanContext& ctx) {
+  return ftr_span_ctx_decode_bin(buf, len, &ctx.ctx_);
+}
+
+SpanName::SpanName(const char* name) : name_(ftr_register_name(name)) {}
+
+ftr_name_id SpanName::raw() const { return name_; }
+
 Span::Span(const char* name, const SpanContext& parent)
     : span_(ftr_create_root_span(name, parent.raw())) {}
 
@@ -258,28 +682,66 @@ Span::Span(const char* name, const Span& parent)
 
 Span::Span(const char* name) : span_(ftr_create_child_span_enter_loc(name)) {}
 
+Span::Span(const SpanName& name, const SpanContext& parent)
+    : span_(ftr_create_root_span_id(name.raw(), parent.raw())) {}
+
+Span::Span(const SpanName& name, const Span& parent)
+    : span_(ftr_create_child_span_enter_id(name.raw(), parent.raw())) {}
+
+Span::Span(const SpanName& name)
+    : span_(ftr_create_child_span_enter_loc_id(name.raw())) {}
+
+void Span::enterBatch(const char* const* names, size_t n, const Span& parent,
+                      Span* out) {
+  static_assert(sizeof(Span) == sizeof(ftr_span),
+                "Span must be laid out as ftr_span");
+  for (size_t i = 0; i < n; i++) {
+    ftr_destroy_span(out[i].span_);
+  }
+  ftr_create_child_spans_enter_batch(names, n, parent.raw(),
+                                     reinterpret_cast<ftr_span*>(out));
+}
+
+void Span::enterBatch(const SpanName* names, size_t n, const Span& parent,
+                      Span* out) {
+  static_assert(sizeof(SpanName) == sizeof(ftr_name_id),
+                "SpanName must be laid out as ftr_name_id");
+  for (size_t i = 0; i < n; i++) {
+    ftr_destroy_span(out[i].span_);
+  }
+  ftr_create_child_spans_enter_batch_id(
+      reinterpret_cast<const ftr_name_id*>(names), n, parent.raw(),
+      reinterpret_cast<ftr_span*>(out));
+}
+
+void Span::fromTimestamps(const char* name, const Span& parent,
+                          uint64_t startNs, uint64_t endNs) {
+  ftr_create_child_span_at(name, parent.raw(), startNs, endNs);
+}
+
+void Span::fromTimestamps(const Span& parent, const ftr_timed_span* spans,
+                          size_t n) {
+  ftr_create_child_spans_at(parent.raw(), spans, n);
+}
+
 Span::Span(Span&& other) noexcept : span_(other.span_) {
-  other.span_ =
-      call_rust_function<ftr_span>(&fastrace_glue::ftr_create_noop_span);
+  other.span_._flags = FTR_SPAN_EMPTY;
 }
 
 Span& Span::operator=(Span&& other) noexcept {
   if (this != &other) {
     ftr_destroy_span(span_);
     span_ = other.span_;
-    other.span_ =
-        call_rust_function<ftr_span>(&fastrace_glue::ftr_create_noop_span);
+    other.span_._flags = FTR_SPAN_EMPTY;
   }
   return *this;
 }
 
-Span::Span() {
-  span_ = call_rust_function<ftr_span>(&fastrace_glue::ftr_create_noop_span);
-}
+Span::Span() : span_(ftr_create_noop_span()) {}
 
 Span::~Span() { ftr_destroy_span(span_); }
 
-void Span::cancel() { ftr_cancel_span(span_); }
+void Span::cancel() { ftr_cancel_span(&span_); }
 
 uint64_t Span::elapsed() const { return ftr_span_elapsed(&span_); }
 
@@ -287,29 +749,43 @@ void Span::addProperty(const char* key, const char* value) {
   ftr_span_with_prop(&span_, key, value);
 }
 
+void Span::addProperty(const char* key, double value) {
+  ftr_span_with_prop_f64(&span_, key, value);
+}
+
+void Span::addProperty(const char* key, bool value) {
+  ftr_span_with_prop_bool(&span_, key, value);
+}
+
 void Span::addProperties(
     const std::vector<std::pair<const char*, const char*>>& properties) {
-  if (!properties.empty()) {
-    fastrace_glue::ftr_span_with_props(
-        *reinterpret_cast<ffi::ftr_span*>(&span_),
-        rust::Slice<const char* const>(&properties[0].first, properties.size()),
-        rust::Slice<const char* const>(&properties[0].second,
-                                       properties.size()));
+  if (!properties.empty() && !(span_._flags & FTR_SPAN_EMPTY)) {
+    PropArrays arrays(properties);
+    ftr_span_with_props(&span_, arrays.keys.data(), arrays.vals.data(),
+                        properties.size());
   }
 }
 
 void Span::addEvent(
     const char* name,
     const std::vector<std::pair<const char*, const char*>>& properties) {
-  if (!properties.empty()) {
-    fastrace_glue::ftr_add_ent_to_par(
-        rust::Str(name), *reinterpret_cast<ffi::ftr_span*>(&span_),
-        rust::Slice<const char* const>(&properties[0].first, properties.size()),
-        rust::Slice<const char* const>(&properties[0].second,
-                                       properties.size()));
+  if (!properties.empty() && !(span_._flags & FTR_SPAN_EMPTY)) {
+    PropArrays arrays(properties);
+    ftr_add_ent_to_par(name, &span_, arrays.keys.data(), arrays.vals.data(),
+                       properties.size());
   }
 }
 
+void Span::addProperties(const ftr_prop* properties, size_t n) {
+  if (n) {
+    ftr_span_with_props_ex(&span_, properties, n);
+  }
+}
+
+void Span::addEvent(const char* name, const ftr_prop* properties, size_t n) {
+  ftr_add_ent_to_par_ex(name, &span_, properties, n);
+}
+
 ftr_span* Span::raw() { return &span_; }
 
 const ftr_span* Span::raw() const { return &span_; }
@@ -322,15 +798,18 @@ LocalParentGuard::~LocalParentGuard() { ftr_destroy_loc_par_guar(guard_); }
 LocalSpan::LocalSpan(const char* name)
     : span_(ftr_create_loc_span_enter(name)) {}
 
+LocalSpan::LocalSpan(const SpanName& name)
+    : span_(ftr_create_loc_span_enter_id(name.raw())) {}
+
 LocalSpan::LocalSpan(LocalSpan&& other) noexcept : span_(other.span_) {
-  other.span_ = ftr_loc_span{};
+  other.span_._flags = FTR_SPAN_EMPTY;
 }
 
 LocalSpan& LocalSpan::operator=(LocalSpan&& other) noexcept {
   if (this != &other) {
     ftr_destroy_loc_span(span_);
     span_ = other.span_;
-    other.span_ = ftr_loc_span{};
+    other.span_._flags = FTR_SPAN_EMPTY;
   }
   return *this;
 }
@@ -340,25 +819,36 @@ void LocalSpan::addProperty(const char* key, const char* value) {
   ftr_loc_span_add_prop(key, value);
 }
 
+void LocalSpan::addProperty(const char* key, double value) {
+  ftr_loc_span_add_prop_f64(key, value);
+}
+
+void LocalSpan::addProperty(const char* key, bool value) {
+  ftr_loc_span_add_prop_bool(key, value);
+}
+
 void LocalSpan::addProperties(
     const std::vector<std::pair<const char*, const char*>>& properties) {
-  if (!properties.empty()) {
-    fastrace_glue::ftr_loc_span_add_props(
-        rust::Slice<const char* const>(&properties[0].first, properties.size()),
-        rust::Slice<const char* const>(&properties[0].second,
-                                       properties.size()));
+  if (!properties.empty() && ftr_loc_par_depth) {
+    PropArrays arrays(properties);
+    ftr_loc_span_add_props(arrays.keys.data(), arrays.vals.data(),
+                           properties.size());
+  }
+}
+
+void LocalSpan::addProperties(const ftr_prop* properties, size_t n) {
+  if (n) {
+    ftr_loc_span_add_props_ex(properties, n);
   }
 }
 
 void LocalSpan::addEvent(
     const char* name,
     const std::vector<std::pair<const char*, const char*>>& properties) {
-  if (!properties.empty()) {
-    fastrace_glue::ftr_add_ent_to_loc_par(
-        rust::Str(name),
-        rust::Slice<const char* const>(&properties[0].first, properties.size()),
-        rust::Slice<const char* const>(&properties[0].second,
-                                       properties.size()));
+  if (!properties.empty() && ftr_loc_par_depth) {
+    PropArrays arrays(properties);
+    ftr_add_ent_to_loc_par(name, arrays.keys.data(), arrays.vals.data(),
+                           properties.size());
   }
 }
 
@@ -366,32 +856,134 @@ void LocalSpan::withProperty(const char* key, const char* value) {
   ftr_loc_span_with_prop(&span_, key, value);
 }
 
+void LocalSpan::withProperty(const char* key, double value) {
+  ftr_loc_span_with_prop_f64(&span_, key, value);
+}
+
+void LocalSpan::withProperty(const char* key, bool value) {
+  ftr_loc_span_with_prop_bool(&span_, key, value);
+}
+
 void LocalSpan::withProperties(
     const std::vector<std::pair<const char*, const char*>>& properties) {
-  if (!properties.empty()) {
-    fastrace_glue::ftr_loc_span_with_props(
-        *reinterpret_cast<ffi::ftr_loc_span*>(&span_),
-        rust::Slice<const char* const>(&properties[0].first, properties.size()),
-        rust::Slice<const char* const>(&properties[0].second,
-                                       properties.size()));
+  if (!properties.empty() && !(span_._flags & FTR_SPAN_EMPTY)) {
+    PropArrays arrays(properties);
+    ftr_loc_span_with_props(&span_, arrays.keys.data(), arrays.vals.data(),
+                            properties.size());
+  }
+}
+
+void LocalSpan::withProperties(const ftr_prop* properties, size_t n) {
+  if (n) {
+    ftr_loc_span_with_props_ex(&span_, properties, n);
   }
 }
 
+void LocalSpan::addEvent(const char* name, const ftr_prop* properties,
+                         size_t n) {
+  ftr_add_ent_to_loc_par_ex(name, properties, n);
+}
+
 CollectorConfig::CollectorConfig() : cfg_(ftr_create_def_coll_cfg()) {}
 
 void CollectorConfig::setMaxSpansPerTrace(size_t max) {
   cfg_ = ftr_set_max_spans_per_trace(cfg_, max);
 }
 
+void CollectorConfig::setMaxBytesPerTrace(size_t n) {
+  cfg_ = ftr_set_max_bytes_per_trace(cfg_, n);
+}
+
 void CollectorConfig::setReportInterval(uint64_t interval) {
   cfg_ = ftr_set_report_interval(cfg_, interval);
 }
 
+void CollectorConfig::setSampleRatio(double ratio) {
+  cfg_ = ftr_set_sample_ratio(cfg_, ratio);
+}
+
+void CollectorConfig::setSampleRateLimit(double perSecond, uint64_t burst) {
+  cfg_ = ftr_set_sample_rate_limit(cfg_, perSecond, burst);
+}
+
+void CollectorConfig::setRootSampleRatio(const char* name, double ratio) {
+  cfg_ = ftr_set_root_sample_ratio(cfg_, name, ratio);
+}
+
+void CollectorConfig::setRootSampleRateLimit(const char* name,
+                                             double perSecond, uint64_t burst) {
+  cfg_ = ftr_set_root_sample_rate_limit(cfg_, name, perSecond, burst);
+}
+
+void CollectorConfig::setTailMinDuration(uint64_t ns) {
+  cfg_ = ftr_set_tail_min_duration(cfg_, ns);
+}
+
+void CollectorConfig::setTailPercentile(double percentile) {
+  cfg_ = ftr_set_tail_percentile(cfg_, percentile);
+}
+
+void CollectorConfig::setTailErrorProperty(const char* key) {
+  cfg_ = ftr_set_tail_error_prop(cfg_, key);
+}
+
+void CollectorConfig::setQueueMaxSpans(size_t n) {
+  cfg_ = ftr_set_queue_max_spans(cfg_, n);
+}
+
+void CollectorConfig::setQueueMaxBytes(size_t n) {
+  cfg_ = ftr_set_queue_max_bytes(cfg_, n);
+}
+
+void CollectorConfig::setQueueOverflow(ftr_overflow policy) {
+  cfg_ = ftr_set_queue_overflow(cfg_, policy);
+}
+
 ftr_coll_cfg CollectorConfig::raw() const { return cfg_; }
 
 OTLPExporterConfig::OTLPExporterConfig()
     : cfg_(ftr_create_def_otlp_exp_cfg()) {}
 
+void OTLPExporterConfig::setWorkerThreads(size_t n) {
+  cfg_ = ftr_set_otlp_rt_workers(cfg_, n);
+}
+
+void OTLPExporterConfig::setCpuAffinity(const std::vector<uint32_t>& cpus) {
+  cfg_ = ftr_set_otlp_rt_cpus(cfg_, cpus.data(), cpus.size());
+}
+
+void OTLPExporterConfig::setCurrentThread() {
+  cfg_ = ftr_set_otlp_rt_cur_thread(cfg_);
+}
+
+void OTLPExporterConfig::setSpawner(ftr_rt_spawn_fn spawn, void* userData) {
+  cfg_ = ftr_set_otlp_rt_spawner(cfg_, spawn, userData);
+}
+
+void OTLPExporterConfig::setProtocol(ftr_otlp_protocol protocol) {
+  cfg_ = ftr_set_otlp_protocol(cfg_, protocol);
+}
+
+void OTLPExporterConfig::setEndpoint(const char* endpoint) {
+  cfg_ = ftr_set_otlp_endpoint(cfg_, endpoint);
+}
+
+void OTLPExporterConfig::setCompression(ftr_otlp_compression compression) {
+  cfg_ = ftr_set_otlp_compression(cfg_, compression);
+}
+
+void OTLPExporterConfig::addHeader(const char* key, const char* val) {
+  cfg_ = ftr_add_otlp_header(cfg_, key, val);
+}
+
+void OTLPExporterConfig::setTimeout(uint64_t ms) {
+  cfg_ = ftr_set_otlp_timeout(cfg_, ms);
+}
+
+void OTLPExporterConfig::setMaxBatchBytes(size_t n) {
+  cfg_ = ftr_set_otlp_max_batch_bytes(cfg_, n);
+}
+
 ftr_otlp_exp_cfg OTLPExporterConfig::raw() const { return cfg_; }
 
 OpenTelemetryReporter::OpenTelemetryReporter(const OTLPExporterConfig& config)
@@ -423,6 +1015,76 @@ void setOpenTelemetryReporter(OpenTelemetryReporter& reporter,
 
 void setConsoleReporter() { ftr_set_cons_rptr(); }
 
+bool setRingFileReporter(const char* dir, size_t fileBytes, size_t files,
+                         const CollectorConfig& config) {
+  return ftr_set_ring_rptr(dir, fileBytes, files, config.raw());
+}
+
 void flush() { ftr_flush(); }
 
+ftr_collector_stats collectorStats() { return ftr_get_collector_stats(); }
+
+ftr_clock_source clockSource() { return ftr_get_clock_source(); }
+
+namespace {
+
+// Calls and frees the `std::function` passed to `ftr_flush_async`.
+void flushDone(ftr_flush_stats stats, void* user_data) {
+  auto done =
+      static_cast<std::function<void(const ftr_flush_stats&)>*>(user_data);
+  (*done)(stats);
+  delete done;
+}
+
+// Forward the batches of `setReporter` to the reporter, and free it.
+void reportTo(const ftr_span_view* spans, size_t n, void* reporter) {
+  static_cast<Reporter*>(reporter)->report(spans, n);
+}
+
+void deleteReporter(void* reporter) { delete static_cast<Reporter*>(reporter); }
+
+void reportColumnsTo(const ftr_span_columns* batch, void* reporter) {
+  static_cast<ColumnarReporter*>(reporter)->report(*batch);
+}
+
+void deleteColumnarReporter(void* reporter) {
+  delete static_cast<ColumnarReporter*>(reporter);
+}
+
+}  // namespace
+
+void setReporter(std::unique_ptr<Reporter> reporter,
+                 const CollectorConfig& config) {
+  ftr_coll_cfg cfg = config.raw();
+  fastrace_glue::ftr_set_custom_rptr(
+      reinterpret_cast<size_t>(&reportTo),
+      reinterpret_cast<size_t>(&deleteReporter),
+      reinterpret_cast<size_t>(reporter.release()),
+      *reinterpret_cast<ffi::ftr_coll_cfg*>(&cfg));
+}
+
+void setReporter(std::unique_ptr<ColumnarReporter> reporter,
+                 const CollectorConfig& config) {
+  ftr_coll_cfg cfg = config.raw();
+  fastrace_glue::ftr_set_columnar_rptr(
+      reinterpret_cast<size_t>(&reportColumnsTo),
+      reinterpret_cast<size_t>(&deleteColumnarReporter),
+      reinterpret_cast<size_t>(reporter.release()),
+      *reinterpret_cast<ffi::ftr_coll_cfg*>(&cfg));
+}
+
+void flushAsync(std::function<void(const ftr_flush_stats&)> done) {
+  if (!done) {
+    ftr_flush_async(nullptr, nullptr);
+    return;
+  }
+  ftr_flush_async(
+      flushDone,
+      new std::function<void(const ftr_flush_stats&)>(std::move(done)));
+}
+
+bool flush(uint64_t timeout_ms, ftr_flush_stats* stats) {
+  return ftr_flush_timeout(timeout_ms, stats);
+}
+
 }  // namespace fastrace
@@ -0,0 +1,306 @@
+// Copyright 2023 Wenbo Zhang. Licensed under Apache-2.0.
+
+//! Transport settings of the OTLP exporter, configured through
+//! `ftr_otlp_exp_cfg`.
+
+use std::{
+    collections::{HashMap, HashSet},
+    io::Write,
+    sync::Mutex,
+    time::Duration,
+};
+
+use async_trait::async_trait;
+use fastrace::collector::{Reporter, SpanRecord};
+use once_cell::sync::Lazy;
+use opentelemetry::trace::TraceError;
+use opentelemetry_http::{Bytes, HttpClient, HttpError, Request, Response};
+use opentelemetry_otlp::{Compression, ExportConfig, Protocol, SpanExporter, WithExportConfig};
+use tokio::runtime::Handle;
+use tonic::metadata::{MetadataKey, MetadataMap, MetadataValue};
+
+use crate::queue::span_bytes;
+
+/// Must match `ftr_otlp_protocol`.
+pub const PROTOCOL_GRPC: u32 = 0;
+pub const PROTOCOL_HTTP_PROTOBUF: u32 = 1;
+
+/// Must match `ftr_otlp_compression`.
+const COMPRESSION_NONE: u64 = 0;
+const COMPRESSION_GZIP: u64 = 1;
+const COMPRESSION_ZSTD: u64 = 2;
+
+const DEFAULT_HTTP_ENDPOINT: &str = "http://127.0.0.1:4318";
+
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub struct TransportCfg {
+    /// Replaces the endpoint of `ExportConfig` when set. Kept apart, as the
+    /// `String` there is shared by every copy of the configuration.
+    endpoint: Option<&'static str>,
+    /// The header given last, linked to the ones before.
+    headers: Option<&'static Header>,
+    compression: u64,
+    /// Estimated bytes of spans per export at most, 0 for no limit.
+    max_batch_bytes: u64,
+}
+
+impl Default for TransportCfg {
+    fn default() -> Self {
+        Self {
+            endpoint: None,
+            headers: None,
+            compression: COMPRESSION_NONE,
+            max_batch_bytes: 0,
+        }
+    }
+}
+
+impl TransportCfg {
+    pub fn set_endpoint(&mut self, endpoint: &'static str) {
+        self.endpoint = Some(endpoint);
+    }
+
+    /// Adds a header, replacing any of the same name once the exporter is
+    /// built, see `headers`.
+    pub fn add_header(&mut self, key: &'static str, val: &'static str) {
+        self.headers = Some(Header::intern(Header {
+            key,
+            val,
+            prev: self.headers,
+        }));
+    }
+
+    /// The headers in the order given, the last one of each name only.
+    fn headers(&self) -> Vec<(&'static str, &'static str)> {
+        let mut headers: Vec<(&'static str, &'static str)> = Vec::new();
+        let mut header = self.headers;
+        while let Some(&Header { key, val, prev }) = header {
+            if !headers.iter().any(|(k, _)| k.eq_ignore_ascii_case(key)) {
+                headers.push((key, val));
+            }
+            header = prev;
+        }
+        headers.reverse();
+        headers
+    }
+
+    pub fn set_compression(&mut self, compression: u64) {
+        self.compression = compression.min(COMPRESSION_ZSTD);
+    }
+
+    pub fn set_max_batch_bytes(&mut self, n: usize) {
+        self.max_batch_bytes = n as u64;
+    }
+
+    pub fn max_batch_bytes(&self) -> u64 {
+        self.max_batch_bytes
+    }
+}
+
+/// A header of `TransportCfg`. Configurations are plain copies, so the list is
+/// immutable and shared, and its nodes are interned like the strings they
+/// hold: giving the same headers again allocates nothing.
+#[derive(PartialEq, Eq, Hash)]
+struct Header {
+    key: &'static str,
+    val: &'static str,
+    prev: Option<&'static Header>,
+}
+
+static HEADERS: Lazy<Mutex<HashSet<&'static Header>>> = Lazy::new(|| Mutex::new(HashSet::new()));
+
+impl Header {
+    fn intern(header: Header) -> &'static Header {
+        let mut headers = HEADERS.lock().unwrap();
+        match headers.get(&header) {
+            Some(&interned) => interned,
+            None => {
+                let interned: &'static Header = Box::leak(Box::new(header));
+                headers.insert(interned);
+                interned
+            }
+        }
+    }
+}
+
+pub fn set_protocol(export: &mut ExportConfig, protocol: u32) {
+    export.protocol = match protocol {
+        PROTOCOL_HTTP_PROTOBUF => Protocol::HttpBinary,
+        _ => Protocol::Grpc,
+    };
+}
+
+pub fn set_timeout(export: &mut ExportConfig, ms: u64) {
+    export.timeout = Duration::from_millis(ms);
+}
+
+/// Builds the exporter described by `export` and `transport`.
+///
+/// Both transports keep their connection across exports: tonic multiplexes
+/// them over one HTTP/2 channel, and the HTTP client pools its connections.
+pub fn build(
+    mut export: ExportConfig,
+    transport: &TransportCfg,
+    runtime: &Handle,
+) -> Result<SpanExporter, TraceError> {
+    if let Some(endpoint) = transport.endpoint {
+        export.endpoint = endpoint.to_string();
+    }
+
+    if matches!(export.protocol, Protocol::Grpc) {
+        // The exporter spawns its connection tasks on the runtime entered
+        // here. Nothing is run on the calling thread, so this works with a
+        // runtime that is driven elsewhere.
+        let _runtime = runtime.enter();
+        let mut metadata = MetadataMap::new();
+        for (key, val) in transport.headers() {
+            if let (Ok(key), Ok(val)) = (
+                MetadataKey::from_bytes(key.to_ascii_lowercase().as_bytes()),
+                MetadataValue::try_from(val),
+            ) {
+                metadata.insert(key, val);
+            }
+        }
+        let mut builder = opentelemetry_otlp::new_exporter()
+            .tonic()
+            .with_export_config(export)
+            .with_metadata(metadata);
+        match transport.compression {
+            COMPRESSION_GZIP => builder = builder.with_compression(Compression::Gzip),
+            COMPRESSION_ZSTD => builder = builder.with_compression(Compression::Zstd),
+            _ => {}
+        }
+        return builder.build_span_exporter();
+    }
+
+    // The default endpoint and `OTEL_EXPORTER_OTLP_ENDPOINT` are the base URL
+    // of the collector, the HTTP exporter expects the one of the traces.
+    if transport.endpoint.is_none() {
+        let base = std::env::var("OTEL_EXPORTER_OTLP_ENDPOINT")
+            .unwrap_or(DEFAULT_HTTP_ENDPOINT.to_string());
+        export.endpoint = format!("{}/v1/traces", base.trim_end_matches('/'));
+    }
+    let headers: HashMap<String, String> = transport
+        .headers()
+        .into_iter()
+        .map(|(key, val)| (key.to_string(), val.to_string()))
+        .collect();
+    let inner = {
+        let _runtime = runtime.enter();
+        reqwest::Client::new()
+    };
+    opentelemetry_otlp::new_exporter()
+        .http()
+        .with_http_client(CompressingClient {
+            inner,
+            runtime: runtime.clone(),
+            compression: transport.compression,
+        })
+        .with_export_config(export)
+        .with_headers(headers)
+        .build_span_exporter()
+}
+
+/// HTTP client compressing the request bodies, which the HTTP exporter does
+/// not do by itself. Requests are sent by tasks of the exporter runtime, so
+/// that they run on its threads, as configured.
+#[derive(Debug)]
+struct CompressingClient {
+    inner: reqwest::Client,
+    runtime: Handle,
+    compression: u64,
+}
+
+#[async_trait]
+impl HttpClient for CompressingClient {
+    async fn send(&self, mut request: Request<Vec<u8>>) -> Result<Response<Bytes>, HttpError> {
+        let encoding = match self.compression {
+            COMPRESSION_GZIP => {
+                let mut encoder =
+                    flate2::write::GzEncoder::new(Vec::new(), flate2::Compression::default());
+                encoder.write_all(request.body())?;
+                *request.body_mut() = encoder.finish()?;
+                Some("gzip")
+            }
+            COMPRESSION_ZSTD => {
+                *request.body_mut() = zstd::encode_all(request.body().as_slice(), 0)?;
+                Some("zstd")
+            }
+            _ => None,
+        };
+        if let Some(encoding) = encoding {
+            request.headers_mut().insert(
+                http::header::CONTENT_ENCODING,
+                http::HeaderValue::from_static(encoding),
+            );
+        }
+        // The exporter awaits this on the reporter thread, outside of any
+        // runtime.
+        let inner = self.inner.clone();
+        self.runtime
+            .spawn(async move { HttpClient::send(&inner, request).await })
+            .await?
+    }
+}
+
+/// Splits the batches handed to the wrapped reporter, so that each holds at
+/// most `max_bytes` of spans as estimated by `span_bytes`.
+pub struct Chunked<R> {
+    inner: R,
+    max_bytes: usize,
+}
+
+impl<R: Reporter> Chunked<R> {
+    pub fn new(inner: R, max_bytes: u64) -> Self {
+        Self {
+            inner,
+            max_bytes: max_bytes as usize,
+        }
+    }
+}
+
+impl<R: Reporter> Reporter for Chunked<R> {
+    fn report(&mut self, spans: Vec<SpanRecord>) {
+        let mut chunk = Vec::new();
+        let mut bytes = 0;
+        for span in spans {
+            let size = span_bytes(&span);
+            if !chunk.is_empty() && bytes + size > self.max_bytes {
+                self.inner.report(std::mem::take(&mut chunk));
+                bytes = 0;
+            }
+            chunk.push(span);
+            bytes += size;
+        }
+        if !chunk.is_empty() {
+            self.inner.report(chunk);
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn headers_keep_the_last_of_each_name() {
+        let mut cfg = TransportCfg::default();
+        assert!(cfg.headers().is_empty());
+        cfg.add_header("authorization", "a");
+        cfg.add_header("x-tenant", "t");
+        cfg.add_header("Authorization", "b");
+        assert_eq!(cfg.headers(), [("x-tenant", "t"), ("Authorization", "b")]);
+    }
+
+    #[test]
+    fn headers_are_interned() {
+        let build = || {
+            let mut cfg = TransportCfg::default();
+            cfg.add_header("x-interned", "1");
+            cfg.add_header("x-interned-too", "2");
+            cfg.headers.unwrap()
+        };
+        assert!(std::ptr::eq(build(), build()));
+    }
+}
@@ -0,0 +1,284 @@
+// Copyright 2023 Wenbo Zhang. Licensed under Apache-2.0.
+
+//! Encoding of span contexts for propagation across processes, without
+//! allocating.
+//!
+//! The W3C `traceparent` value is `00-<trace id>-<parent id>-<flags>` in
+//! lowercase hex. Ids are parsed 8 digits at a time in a `u64`, checking and
+//! converting all of them with a few arithmetic operations instead of one
+//! table lookup and branch per digit.
+//!
+//! The binary format carries the same fields in 26 bytes, for headers of
+//! internal protocols:
+//!
+//! ```text
+//! version  u8        0
+//! trace_id [u8; 16]  big-endian
+//! span_id  [u8; 8]   big-endian
+//! flags    u8        0x01 if sampled
+//! ```
+
+use fastrace::{
+    collector::{SpanId, TraceId},
+    prelude::SpanContext,
+};
+
+/// Length of a `traceparent` value of version 00. Must match
+/// `FTR_TRACEPARENT_LEN`.
+pub const TRACEPARENT_LEN: usize = 55;
+
+/// Length of the binary encoding. Must match `FTR_SPAN_CTX_BIN_LEN`.
+pub const BIN_LEN: usize = 26;
+
+const FLAG_SAMPLED: u8 = 0x01;
+
+const HEX: &[u8; 16] = b"0123456789abcdef";
+
+/// Writes the `traceparent` of `ctx` to the start of `buf`, followed by a NUL
+/// if there is room, returning its length, or 0 if `buf` is too short.
+pub fn encode_w3c(ctx: &SpanContext, buf: &mut [u8]) -> usize {
+    let Some(out) = buf.get_mut(..TRACEPARENT_LEN) else {
+        return 0;
+    };
+    out[..3].copy_from_slice(b"00-");
+    put_hex(&mut out[3..35], &ctx.trace_id.0.to_be_bytes());
+    out[35] = b'-';
+    put_hex(&mut out[36..52], &ctx.span_id.0.to_be_bytes());
+    out[52] = b'-';
+    put_hex(
+        &mut out[53..55],
+        &[if ctx.sampled { FLAG_SAMPLED } else { 0 }],
+    );
+    if let Some(nul) = buf.get_mut(TRACEPARENT_LEN) {
+        *nul = 0;
+    }
+    TRACEPARENT_LEN
+}
+
+fn put_hex(out: &mut [u8], bytes: &[u8]) {
+    for (pair, byte) in out.chunks_exact_mut(2).zip(bytes) {
+        pair[0] = HEX[(byte >> 4) as usize];
+        pair[1] = HEX[(byte & 0xf) as usize];
+    }
+}
+
+/// Parses a `traceparent` value, returning `None` if it is invalid or if the
+/// trace id or parent id is all zeros, as the specification requires.
+pub fn decode_w3c(s: &[u8]) -> Option<SpanContext> {
+    if s.len() < TRACEPARENT_LEN || s[2] != b'-' || s[35] != b'-' || s[52] != b'-' {
+        return None;
+    }
+    let version = hex2(s[0], s[1])?;
+    // Later versions may append fields, after a dash.
+    let valid_len = match version {
+        0 => s.len() == TRACEPARENT_LEN,
+        0xff => false,
+        _ => s.len() == TRACEPARENT_LEN || s[TRACEPARENT_LEN] == b'-',
+    };
+    if !valid_len {
+        return None;
+    }
+
+    let mut trace_id = 0u128;
+    for chunk in s[3..35].chunks_exact(8) {
+        trace_id = trace_id << 32 | hex8(chunk)? as u128;
+    }
+    let span_id = (hex8(&s[36..44])? as u64) << 32 | hex8(&s[44..52])? as u64;
+    let flags = hex2(s[53], s[54])?;
+    if trace_id == 0 || span_id == 0 {
+        return None;
+    }
+
+    Some(SpanContext::new(TraceId(trace_id), SpanId(span_id)).sampled(flags & FLAG_SAMPLED != 0))
+}
+
+/// Writes the binary encoding of `ctx` to the start of `buf`, returning its
+/// length, or 0 if `buf` is too short.
+pub fn encode_bin(ctx: &SpanContext, buf: &mut [u8]) -> usize {
+    let Some(out) = buf.get_mut(..BIN_LEN) else {
+        return 0;
+    };
+    out[0] = 0;
+    out[1..17].copy_from_slice(&ctx.trace_id.0.to_be_bytes());
+    out[17..25].copy_from_slice(&ctx.span_id.0.to_be_bytes());
+    out[25] = if ctx.sampled { FLAG_SAMPLED } else { 0 };
+    BIN_LEN
+}
+
+/// Parses the binary encoding at the start of `buf`, returning `None` if it is
+/// too short, of another version or carries a zero id.
+pub fn decode_bin(buf: &[u8]) -> Option<SpanContext> {
+    let buf = buf.get(..BIN_LEN)?;
+    if buf[0] != 0 {
+        return None;
+    }
+    let trace_id = u128::from_be_bytes(buf[1..17].try_into().unwrap());
+    let span_id = u64::from_be_bytes(buf[17..25].try_into().unwrap());
+    if trace_id == 0 || span_id == 0 {
+        return None;
+    }
+    Some(SpanContext::new(TraceId(trace_id), SpanId(span_id)).sampled(buf[25] & FLAG_SAMPLED != 0))
+}
+
+const ONES: u64 = 0x0101_0101_0101_0101;
+const HIGH: u64 = 0x8080_8080_8080_8080;
+
+/// Parses 8 lowercase hex digits, first one most significant.
+///
+/// Each byte of the `u64` is handled as a lane: letters are told from digits
+/// by their 0x40 bit, and a digit is only accepted if its value maps back to
+/// the same byte and lies in the range of its kind. No lane ever exceeds 0x7f,
+/// so nothing carries into the next one.
+fn hex8(chunk: &[u8]) -> Option<u32> {
+    let v = u64::from_le_bytes(chunk.try_into().ok()?);
+    if v & HIGH != 0 {
+        return None;
+    }
+    let letter = (v >> 6) & ONES;
+    let nibbles = (v & (ONES * 0x0f)) + letter * 9;
+    let at_most_15 = (nibbles + ONES * (0x80 - 16)) & HIGH == 0;
+    let at_least_10 = ((nibbles + ONES * (0x80 - 10)) & HIGH) >> 7;
+    let expected = nibbles + ONES * b'0' as u64 + letter * (b'a' - 10 - b'0') as u64;
+    if !at_most_15 || at_least_10 != letter || expected != v {
+        return None;
+    }
+
+    // Pack the nibbles: pairs into bytes, then bytes into the low half.
+    let bytes = (nibbles << 4 | nibbles >> 8) & 0x00ff_00ff_00ff_00ff;
+    let bytes = (bytes | bytes >> 8) & 0x0000_ffff_0000_ffff;
+    Some(((bytes | bytes >> 16) as u32).swap_bytes())
+}
+
+fn hex2(hi: u8, lo: u8) -> Option<u8> {
+    Some(hex1(hi)? << 4 | hex1(lo)?)
+}
+
+fn hex1(c: u8) -> Option<u8> {
+    match c {
+        b'0'..=b'9' => Some(c - b'0'),
+        b'a'..=b'f' => Some(c - b'a' + 10),
+        _ => None,
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    const TRACEPARENT: &[u8] = b"00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01";
+
+    fn fields(ctx: SpanContext) -> (u128, u64, bool) {
+        (ctx.trace_id.0, ctx.span_id.0, ctx.sampled)
+    }
+
+    fn with(s: &[u8], at: usize, patch: &[u8]) -> Vec<u8> {
+        let mut s = s.to_vec();
+        s[at..at + patch.len()].copy_from_slice(patch);
+        s
+    }
+
+    #[test]
+    fn w3c_round_trip() {
+        for sampled in [true, false] {
+            let ctx = SpanContext::new(TraceId(u128::MAX - 1), SpanId(0x0123_4567_89ab_cdef))
+                .sampled(sampled);
+            let mut buf = [0xffu8; TRACEPARENT_LEN + 1];
+            assert_eq!(encode_w3c(&ctx, &mut buf), TRACEPARENT_LEN);
+            assert_eq!(buf[TRACEPARENT_LEN], 0);
+            let ctx2 = decode_w3c(&buf[..TRACEPARENT_LEN]).unwrap();
+            assert_eq!(fields(ctx2), fields(ctx));
+        }
+
+        let ctx = decode_w3c(TRACEPARENT).unwrap();
+        assert_eq!(
+            fields(ctx),
+            (0x4bf92f3577b34da6a3ce929d0e0e4736, 0x00f067aa0ba902b7, true)
+        );
+        let mut buf = [0u8; TRACEPARENT_LEN];
+        assert_eq!(encode_w3c(&ctx, &mut buf), TRACEPARENT_LEN);
+        assert_eq!(&buf[..], TRACEPARENT);
+    }
+
+    #[test]
+    fn w3c_short_buffers() {
+        let ctx = decode_w3c(TRACEPARENT).unwrap();
+        let mut buf = [0u8; TRACEPARENT_LEN - 1];
+        assert_eq!(encode_w3c(&ctx, &mut buf), 0);
+        assert_eq!(encode_w3c(&ctx, &mut []), 0);
+        for len in 0..TRACEPARENT_LEN {
+            assert!(decode_w3c(&TRACEPARENT[..len]).is_none());
+        }
+    }
+
+    #[test]
+    fn w3c_invalid() {
+        // Uppercase hex, in each field.
+        assert!(decode_w3c(&with(TRACEPARENT, 3, b"4BF9")).is_none());
+        assert!(decode_w3c(&with(TRACEPARENT, 40, b"AA")).is_none());
+        assert!(decode_w3c(&with(TRACEPARENT, 53, b"0A")).is_none());
+        assert!(decode_w3c(&with(TRACEPARENT, 0, b"0A")).is_none());
+        // Non-hex digits and misplaced dashes.
+        assert!(decode_w3c(&with(TRACEPARENT, 10, b"g")).is_none());
+        assert!(decode_w3c(&with(TRACEPARENT, 50, b"-")).is_none());
+        assert!(decode_w3c(&with(TRACEPARENT, 35, b"0")).is_none());
+        // All-zero ids.
+        assert!(decode_w3c(&with(TRACEPARENT, 3, &[b'0'; 32])).is_none());
+        assert!(decode_w3c(&with(TRACEPARENT, 36, &[b'0'; 16])).is_none());
+    }
+
+    #[test]
+    fn w3c_versions() {
+        assert!(decode_w3c(&with(TRACEPARENT, 0, b"ff")).is_none());
+        // Version 00 has no further fields.
+        assert!(decode_w3c(&[TRACEPARENT, b"-00"].concat()).is_none());
+
+        let future = with(TRACEPARENT, 0, b"cc");
+        assert!(decode_w3c(&future).is_some());
+        let ctx = decode_w3c(&[&future[..], b"-what-the-future-will-be-like"].concat()).unwrap();
+        assert_eq!(fields(ctx), fields(decode_w3c(TRACEPARENT).unwrap()));
+        assert!(decode_w3c(&[&future[..], b"x"].concat()).is_none());
+    }
+
+    #[test]
+    fn bin_round_trip() {
+        for sampled in [true, false] {
+            let ctx =
+                SpanContext::new(TraceId(0x0102_0304 << 64 | 5), SpanId(u64::MAX)).sampled(sampled);
+            let mut buf = [0xffu8; BIN_LEN + 4];
+            assert_eq!(encode_bin(&ctx, &mut buf), BIN_LEN);
+            assert_eq!(buf[0], 0);
+            assert_eq!(buf[1..5], [0, 0, 0, 0]);
+            assert_eq!(buf[13..17], [0, 0, 0, 5]);
+            assert_eq!(buf[17..25], [0xff; 8]);
+            assert_eq!(buf[25], sampled as u8);
+            assert_eq!(buf[BIN_LEN], 0xff);
+            assert_eq!(fields(decode_bin(&buf).unwrap()), fields(ctx));
+        }
+    }
+
+    #[test]
+    fn bin_invalid() {
+        let ctx = SpanContext::new(TraceId(1), SpanId(2));
+        let mut buf = [0u8; BIN_LEN];
+        assert_eq!(encode_bin(&ctx, &mut buf[..BIN_LEN - 1]), 0);
+        assert_eq!(encode_bin(&ctx, &mut buf), BIN_LEN);
+        assert!(decode_bin(&buf[..BIN_LEN - 1]).is_none());
+        assert!(decode_bin(&with(&buf, 0, &[1])).is_none());
+        assert!(decode_bin(&with(&buf, 1, &[0; 16])).is_none());
+        assert!(decode_bin(&with(&buf, 17, &[0; 8])).is_none());
+    }
+
+    #[test]
+    fn hex8_matches_hex1() {
+        for lane in 0..8 {
+            for c in 0..=u8::MAX {
+                let chunk = with(b"00000000", lane, &[c]);
+                let expected = hex1(c).map(|digit| (digit as u32) << (4 * (7 - lane)));
+                assert_eq!(hex8(&chunk), expected, "lane {lane}, byte {c:#04x}");
+            }
+        }
+        assert_eq!(hex8(b"0123abcd"), Some(0x0123_abcd));
+        assert_eq!(hex8(b"fedcba98"), Some(0xfedc_ba98));
+        assert_eq!(hex8(b"0123abc"), None);
+    }
+}
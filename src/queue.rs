@@ -0,0 +1,530 @@
+// Copyright 2023 Wenbo Zhang. Licensed under Apache-2.0.
+
+//! Queue between the collector and the reporter, bounded through
+//! `ftr_coll_cfg`.
+//!
+//! fastrace calls the reporter on its collector thread, and keeps buffering
+//! the spans of every thread while the reporter is busy. The reporter runs on
+//! a thread of its own instead, fed by this queue, so that a stalled exporter
+//! only holds up that thread and, once a cap is set, fills the queue and hits
+//! the cap rather than the collector's unbounded buffers. The same thread
+//! serves the flushes queued through `flush`, between batches.
+
+use std::{
+    borrow::Cow,
+    cell::Cell,
+    collections::VecDeque,
+    mem::{size_of, size_of_val},
+    sync::{
+        atomic::{AtomicU64, Ordering},
+        Arc, Condvar, Mutex, MutexGuard,
+    },
+    time::{Duration, Instant},
+};
+
+use fastrace::collector::{Reporter, SpanRecord};
+use once_cell::sync::Lazy;
+
+use crate::{
+    flush::{self, Request},
+    stats,
+};
+
+/// Must match `ftr_overflow`.
+const DROP_NEWEST: u64 = 0;
+const DROP_OLDEST: u64 = 1;
+const BLOCK: u64 = 2;
+
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+pub struct QueueCfg {
+    /// Spans buffered at most, 0 for no limit.
+    max_spans: u64,
+    /// Estimated bytes buffered at most, 0 for no limit.
+    max_bytes: u64,
+    policy: u64,
+}
+
+impl QueueCfg {
+    pub fn set_max_spans(&mut self, n: usize) {
+        self.max_spans = n as u64;
+    }
+
+    pub fn set_max_bytes(&mut self, n: usize) {
+        self.max_bytes = n as u64;
+    }
+
+    pub fn set_policy(&mut self, policy: u64) {
+        self.policy = policy.min(BLOCK);
+    }
+}
+
+/// Spans buffered by the current queue, and their estimated size.
+pub static QUEUE_SPANS: AtomicU64 = AtomicU64::new(0);
+pub static QUEUE_BYTES: AtomicU64 = AtomicU64::new(0);
+
+fn props_bytes(props: &[(Cow<'static, str>, Cow<'static, str>)]) -> usize {
+    props
+        .iter()
+        .map(|(k, v)| size_of::<(String, String)>() + k.len() + v.len())
+        .sum()
+}
+
+/// Estimates the memory held by `span`.
+pub fn span_bytes(span: &SpanRecord) -> usize {
+    size_of::<SpanRecord>()
+        + span.name.len()
+        + props_bytes(&span.properties)
+        + span
+            .events
+            .iter()
+            .map(|event| size_of_val(event) + event.name.len() + props_bytes(&event.properties))
+            .sum::<usize>()
+}
+
+struct State {
+    spans: VecDeque<SpanRecord>,
+    bytes: usize,
+    /// Spans handed to the reporter and not reported yet.
+    exporting: usize,
+    /// Flushes waiting for the report thread.
+    flushes: Vec<Request>,
+    /// Set while the report thread waits for fastrace to flush into the
+    /// queue, so that `BLOCK` does not wait for it in turn.
+    flushing: bool,
+    closed: bool,
+}
+
+impl State {
+    fn fits(&self, cfg: &QueueCfg, bytes: usize) -> bool {
+        // A span is always taken by an empty queue, however large.
+        self.spans.is_empty()
+            || ((cfg.max_spans == 0 || (self.spans.len() as u64) < cfg.max_spans)
+                && (cfg.max_bytes == 0 || (self.bytes + bytes) as u64 <= cfg.max_bytes))
+    }
+
+    fn publish(&self) {
+        QUEUE_SPANS.store(self.spans.len() as u64, Ordering::Relaxed);
+        QUEUE_BYTES.store(self.bytes as u64, Ordering::Relaxed);
+    }
+}
+
+struct Shared {
+    cfg: QueueCfg,
+    state: Mutex<State>,
+    /// Signaled when spans or flushes are queued, or the queue is closed.
+    queued: Condvar,
+    /// Signaled when spans are taken by the reporter thread, or it is done
+    /// reporting them.
+    taken: Condvar,
+}
+
+thread_local! {
+    static ON_REPORT_THREAD: Cell<bool> = const { Cell::new(false) };
+}
+
+impl Shared {
+    fn new(cfg: QueueCfg) -> Self {
+        Self {
+            cfg,
+            state: Mutex::new(State {
+                spans: VecDeque::new(),
+                bytes: 0,
+                exporting: 0,
+                flushes: Vec::new(),
+                flushing: false,
+                closed: false,
+            }),
+            queued: Condvar::new(),
+            taken: Condvar::new(),
+        }
+    }
+
+    fn lock(&self) -> MutexGuard<State> {
+        self.state.lock().unwrap()
+    }
+
+    /// Queues `spans`, returning how many were dropped.
+    fn push(&self, spans: Vec<SpanRecord>) -> usize {
+        let mut state = self.lock();
+        let mut dropped = 0;
+        for span in spans {
+            let bytes = span_bytes(&span);
+            let mut admit = true;
+            while !state.fits(&self.cfg, bytes) {
+                match self.cfg.policy {
+                    DROP_OLDEST => {
+                        let oldest = state.spans.pop_front().unwrap();
+                        state.bytes -= span_bytes(&oldest);
+                        dropped += 1;
+                    }
+                    // The report thread takes no spans while it flushes, so
+                    // they are let in past the cap until it is done.
+                    BLOCK if state.flushing => break,
+                    BLOCK => state = self.taken.wait(state).unwrap(),
+                    _ => {
+                        admit = false;
+                        break;
+                    }
+                }
+            }
+            if admit {
+                state.spans.push_back(span);
+                state.bytes += bytes;
+            } else {
+                dropped += 1;
+            }
+        }
+        state.publish();
+        drop(state);
+        stats::add_dropped(dropped);
+        self.queued.notify_one();
+        dropped
+    }
+
+    fn run(&self, mut reporter: impl Reporter) {
+        ON_REPORT_THREAD.with(|on| on.set(true));
+        let mut state = self.lock();
+        loop {
+            if !state.flushes.is_empty() {
+                let requests = std::mem::take(&mut state.flushes);
+                drop(state);
+                self.serve(requests, &mut reporter);
+                state = self.lock();
+            } else if !state.spans.is_empty() {
+                state = self.report(state, &mut reporter);
+            } else if state.closed {
+                return;
+            } else {
+                state = self.queued.wait(state).unwrap();
+            }
+        }
+    }
+
+    /// Reports the queued spans, and takes the lock again once done.
+    fn report<'a>(
+        &'a self,
+        mut state: MutexGuard<'a, State>,
+        reporter: &mut impl Reporter,
+    ) -> MutexGuard<'a, State> {
+        let spans = Vec::from(std::mem::take(&mut state.spans));
+        state.bytes = 0;
+        state.exporting = spans.len();
+        state.publish();
+        drop(state);
+        self.taken.notify_all();
+
+        reporter.report(spans);
+
+        let mut state = self.lock();
+        state.exporting = 0;
+        self.taken.notify_all();
+        state
+    }
+
+    /// Has fastrace hand the spans it buffers over to the queue, from the
+    /// report thread.
+    fn collect(&self) {
+        self.lock().flushing = true;
+        self.taken.notify_all();
+        fastrace::flush();
+        self.lock().flushing = false;
+    }
+
+    /// Serves `requests`: collects the spans buffered so far and reports them,
+    /// unless every deadline has passed meanwhile.
+    fn serve(&self, requests: Vec<Request>, reporter: &mut impl Reporter) {
+        let start = flush::Snapshot::take();
+        self.collect();
+        let mut state = self.lock();
+        let deadline = requests.iter().map(|request| request.deadline).max();
+        if !state.spans.is_empty() && deadline.is_some_and(|deadline| Instant::now() < deadline) {
+            state = self.report(state, reporter);
+        }
+        let pending = (state.spans.len() + state.exporting) as u64;
+        drop(state);
+
+        let stats = start.stats(pending);
+        for request in requests {
+            request.complete(stats);
+        }
+    }
+
+    fn wait_idle(&self, timeout: Option<Duration>) -> u64 {
+        let state = self.lock();
+        let busy = |state: &mut State| !state.spans.is_empty() || state.exporting > 0;
+        let state = match timeout {
+            Some(timeout) => {
+                self.taken
+                    .wait_timeout_while(state, timeout, busy)
+                    .unwrap()
+                    .0
+            }
+            None => self.taken.wait_while(state, busy).unwrap(),
+        };
+        (state.spans.len() + state.exporting) as u64
+    }
+}
+
+/// The queue fed by the collector, to hand flushes to.
+static CURRENT: Lazy<Mutex<Option<Arc<Shared>>>> = Lazy::new(|| Mutex::new(None));
+
+fn current() -> Option<Arc<Shared>> {
+    CURRENT.lock().unwrap().clone()
+}
+
+/// Reporter handing spans over to the thread that runs the wrapped reporter.
+pub struct Queue {
+    shared: Arc<Shared>,
+}
+
+impl Queue {
+    pub fn new(reporter: impl Reporter, cfg: QueueCfg) -> Self {
+        let shared = Arc::new(Shared::new(cfg));
+        let worker = shared.clone();
+        std::thread::Builder::new()
+            .name("fastrace-report".to_string())
+            .spawn(move || worker.run(reporter))
+            .expect("Failed to spawn the report thread");
+        *CURRENT.lock().unwrap() = Some(shared.clone());
+        Self { shared }
+    }
+}
+
+impl Reporter for Queue {
+    fn report(&mut self, spans: Vec<SpanRecord>) {
+        self.shared.push(spans);
+    }
+}
+
+impl Drop for Queue {
+    /// Lets the reporter thread exit once it has reported what is left.
+    fn drop(&mut self) {
+        let mut current = CURRENT.lock().unwrap();
+        if current
+            .as_ref()
+            .is_some_and(|shared| Arc::ptr_eq(shared, &self.shared))
+        {
+            *current = None;
+        }
+        drop(current);
+        self.shared.lock().closed = true;
+        self.shared.queued.notify_one();
+    }
+}
+
+/// Whether the calling thread runs a reporter, e.g. a custom one calling back
+/// into the library.
+pub fn on_report_thread() -> bool {
+    ON_REPORT_THREAD.with(Cell::get)
+}
+
+/// Hands `request` to the report thread, or back if no reporter is set.
+pub fn request_flush(request: Request) -> Result<(), Request> {
+    let Some(shared) = current() else {
+        return Err(request);
+    };
+    shared.lock().flushes.push(request);
+    shared.queued.notify_one();
+    Ok(())
+}
+
+/// Withdraws the flush `id` if the report thread has not taken it yet.
+pub fn cancel_flush(id: u64) {
+    if let Some(shared) = current() {
+        shared.lock().flushes.retain(|request| request.id() != id);
+    }
+}
+
+/// Flushes the spans buffered by fastrace and waits until they are reported.
+/// Returns the spans still queued, only ever non-zero on the report thread,
+/// which cannot wait for itself and reports them once the caller returns.
+pub fn flush() -> u64 {
+    match current() {
+        Some(shared) if on_report_thread() => {
+            shared.collect();
+            shared.lock().spans.len() as u64
+        }
+        Some(shared) => {
+            fastrace::flush();
+            shared.wait_idle(None)
+        }
+        None => {
+            fastrace::flush();
+            0
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use std::{sync::mpsc, thread, time::Duration};
+
+    use fastrace::collector::SpanId;
+
+    use super::*;
+
+    fn spans(ids: std::ops::Range<u64>) -> Vec<SpanRecord> {
+        ids.map(|id| SpanRecord {
+            span_id: SpanId(id),
+            ..SpanRecord::default()
+        })
+        .collect()
+    }
+
+    fn queued(shared: &Shared) -> Vec<u64> {
+        shared
+            .lock()
+            .spans
+            .iter()
+            .map(|span| span.span_id.0)
+            .collect()
+    }
+
+    fn new_shared(cfg: impl FnOnce(&mut QueueCfg)) -> Arc<Shared> {
+        let mut queue = QueueCfg::default();
+        cfg(&mut queue);
+        Arc::new(Shared::new(queue))
+    }
+
+    /// Takes the queued spans, as the report thread does.
+    fn take(shared: &Shared) -> usize {
+        let spans = std::mem::take(&mut shared.lock().spans);
+        shared.lock().bytes = 0;
+        shared.taken.notify_all();
+        spans.len()
+    }
+
+    #[test]
+    fn unbounded() {
+        let shared = new_shared(|_| {});
+        assert_eq!(shared.push(spans(0..1000)), 0);
+        assert_eq!(queued(&shared).len(), 1000);
+    }
+
+    #[test]
+    fn drop_newest() {
+        let shared = new_shared(|cfg| cfg.set_max_spans(2));
+        assert_eq!(shared.push(spans(0..3)), 1);
+        assert_eq!(shared.push(spans(3..4)), 1);
+        assert_eq!(queued(&shared), [0, 1]);
+    }
+
+    #[test]
+    fn drop_oldest() {
+        let shared = new_shared(|cfg| {
+            cfg.set_max_spans(2);
+            cfg.set_policy(DROP_OLDEST);
+        });
+        assert_eq!(shared.push(spans(0..3)), 1);
+        assert_eq!(shared.push(spans(3..4)), 1);
+        assert_eq!(queued(&shared), [2, 3]);
+    }
+
+    #[test]
+    fn byte_accounting() {
+        let mut big = spans(0..1).pop().unwrap();
+        big.name = "x".repeat(1000).into();
+        big.properties.push(("key".into(), "value".into()));
+        let small = span_bytes(&spans(0..1)[0]);
+        assert_eq!(
+            span_bytes(&big),
+            small + 1000 + size_of::<(String, String)>() + 8
+        );
+
+        let shared = new_shared(|cfg| cfg.set_max_bytes(small * 2));
+        // An empty queue takes a span however large.
+        assert_eq!(shared.push(vec![big.clone()]), 0);
+        assert_eq!(shared.lock().bytes, span_bytes(&big));
+        assert_eq!(shared.push(spans(1..2)), 1);
+
+        take(&shared);
+        assert_eq!(shared.push(spans(1..4)), 1);
+        assert_eq!(shared.lock().bytes, small * 2);
+
+        let shared = new_shared(|cfg| {
+            cfg.set_max_bytes(small * 2);
+            cfg.set_policy(DROP_OLDEST);
+        });
+        shared.push(spans(0..2));
+        assert_eq!(shared.push(vec![big.clone()]), 2);
+        assert_eq!(shared.lock().bytes, span_bytes(&big));
+    }
+
+    #[test]
+    fn block_waits_for_room() {
+        let shared = new_shared(|cfg| {
+            cfg.set_max_spans(2);
+            cfg.set_policy(BLOCK);
+        });
+        shared.push(spans(0..2));
+        let pusher = {
+            let shared = shared.clone();
+            thread::spawn(move || shared.push(spans(2..5)))
+        };
+        thread::sleep(Duration::from_millis(50));
+        assert!(!pusher.is_finished());
+        assert_eq!(take(&shared), 2);
+        thread::sleep(Duration::from_millis(50));
+        assert!(!pusher.is_finished());
+        assert_eq!(queued(&shared), [2, 3]);
+
+        // A flush on the report thread lets the rest in past the cap.
+        shared.lock().flushing = true;
+        shared.taken.notify_all();
+        assert_eq!(pusher.join().unwrap(), 0);
+        assert_eq!(queued(&shared), [2, 3, 4]);
+    }
+
+    struct Gated(mpsc::Receiver<()>);
+
+    impl Reporter for Gated {
+        fn report(&mut self, _: Vec<SpanRecord>) {
+            self.0.recv().unwrap();
+        }
+    }
+
+    #[test]
+    fn wait_idle_until_reported() {
+        let shared = new_shared(|_| {});
+        let (open, gate) = mpsc::channel();
+        let worker = {
+            let shared = shared.clone();
+            thread::spawn(move || shared.run(Gated(gate)))
+        };
+        assert_eq!(shared.wait_idle(Some(Duration::ZERO)), 0);
+
+        shared.push(spans(0..3));
+        assert_eq!(shared.wait_idle(Some(Duration::from_millis(20))), 3);
+        shared.push(spans(3..5));
+        assert_eq!(shared.wait_idle(Some(Duration::from_millis(20))), 5);
+
+        open.send(()).unwrap();
+        open.send(()).unwrap();
+        assert_eq!(shared.wait_idle(None), 0);
+
+        shared.lock().closed = true;
+        shared.queued.notify_one();
+        worker.join().unwrap();
+    }
+
+    struct Flushing(mpsc::Sender<u64>);
+
+    impl Reporter for Flushing {
+        fn report(&mut self, _: Vec<SpanRecord>) {
+            self.0.send(flush()).unwrap();
+        }
+    }
+
+    #[test]
+    fn flush_on_report_thread() {
+        let (tx, rx) = mpsc::channel();
+        let mut queue = Queue::new(Flushing(tx), QueueCfg::default());
+        assert!(!on_report_thread());
+        queue.report(spans(0..1));
+        assert_eq!(rx.recv_timeout(Duration::from_secs(5)), Ok(0));
+
+        drop(queue);
+        assert!(current().is_none());
+    }
+}
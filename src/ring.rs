@@ -0,0 +1,377 @@
+// Copyright 2023 Wenbo Zhang. Licensed under Apache-2.0.
+
+//! Reporter appending span records to a ring of memory-mapped files, for
+//! capturing at full rate without a collector. `tools/ring2otlp.py` reads
+//! them back.
+//!
+//! The ring is `files` files of `file_bytes` bytes each, named
+//! `fastrace-<index>.ring` in a directory. Each file starts with a header:
+//!
+//! ```text
+//! magic    [u8; 8]  "FTRRING\0"
+//! version  u32      1
+//! reserved u32
+//! seq      u64      increases with every file started, across restarts
+//! used     u64      bytes written so far, header included
+//! ```
+//!
+//! followed by records, each a `u32` length, itself excluded, and:
+//!
+//! ```text
+//! trace_id u128, span_id u64, parent_id u64, begin_unix_ns u64, duration_ns u64
+//! name: str, properties: varint count of (key: str, val: str),
+//! events: varint count of (name: str, timestamp_unix_ns u64, properties)
+//! ```
+//!
+//! Integers are little-endian, and `str` is a varint length followed by UTF-8
+//! bytes. `used` is stored after each batch is written, so a reader never sees
+//! a partial record. Once a file is full, writing moves on to the next one,
+//! overwriting the oldest records.
+
+use std::{
+    fs::OpenOptions,
+    io,
+    os::fd::AsRawFd,
+    path::{Path, PathBuf},
+    ptr,
+    sync::atomic::{AtomicU64, Ordering},
+};
+
+use fastrace::collector::{Reporter, SpanRecord};
+
+use crate::stats;
+
+const MAGIC: &[u8; 8] = b"FTRRING\0";
+const VERSION: u32 = 1;
+const HEADER_BYTES: usize = 32;
+const SEQ_OFFSET: usize = 16;
+const USED_OFFSET: usize = 24;
+
+/// A memory-mapped file of the ring.
+struct Mapping {
+    ptr: *mut u8,
+    len: usize,
+}
+
+impl Mapping {
+    fn open(path: &Path, len: usize) -> io::Result<Self> {
+        let file = OpenOptions::new()
+            .read(true)
+            .write(true)
+            .create(true)
+            .truncate(false)
+            .open(path)?;
+        file.set_len(len as u64)?;
+        let ptr = unsafe {
+            libc::mmap(
+                ptr::null_mut(),
+                len,
+                libc::PROT_READ | libc::PROT_WRITE,
+                libc::MAP_SHARED,
+                file.as_raw_fd(),
+                0,
+            )
+        };
+        if ptr == libc::MAP_FAILED {
+            return Err(io::Error::last_os_error());
+        }
+        // The mapping stays valid once the file is closed.
+        Ok(Self {
+            ptr: ptr as *mut u8,
+            len,
+        })
+    }
+
+    fn bytes(&mut self) -> &mut [u8] {
+        unsafe { std::slice::from_raw_parts_mut(self.ptr, self.len) }
+    }
+
+    fn used(&self) -> &AtomicU64 {
+        unsafe { &*(self.ptr.add(USED_OFFSET) as *const AtomicU64) }
+    }
+
+    /// Returns the sequence number of the file, if it holds a ring header.
+    fn seq(&mut self) -> Option<u64> {
+        let bytes = self.bytes();
+        (&bytes[..8] == MAGIC && bytes[8..12] == VERSION.to_le_bytes())
+            .then(|| u64::from_le_bytes(bytes[SEQ_OFFSET..SEQ_OFFSET + 8].try_into().unwrap()))
+    }
+
+    fn reset(&mut self, seq: u64) {
+        let bytes = self.bytes();
+        bytes[..8].copy_from_slice(MAGIC);
+        bytes[8..12].copy_from_slice(&VERSION.to_le_bytes());
+        bytes[12..16].fill(0);
+        bytes[SEQ_OFFSET..SEQ_OFFSET + 8].copy_from_slice(&seq.to_le_bytes());
+        self.used().store(HEADER_BYTES as u64, Ordering::Release);
+    }
+}
+
+impl Drop for Mapping {
+    fn drop(&mut self) {
+        unsafe {
+            libc::munmap(self.ptr as *mut libc::c_void, self.len);
+        }
+    }
+}
+
+pub struct RingReporter {
+    dir: PathBuf,
+    file_bytes: usize,
+    files: usize,
+    index: usize,
+    seq: u64,
+    current: Mapping,
+    /// Encoding buffer, reused across records.
+    buf: Vec<u8>,
+}
+
+// The mapping is only accessed by the thread owning the reporter.
+unsafe impl Send for RingReporter {}
+
+impl RingReporter {
+    /// Opens the ring in `dir`, resuming after the newest file of a previous
+    /// run if any.
+    pub fn open(dir: &Path, file_bytes: usize, files: usize) -> io::Result<Self> {
+        if file_bytes <= HEADER_BYTES || files == 0 {
+            return Err(io::Error::from(io::ErrorKind::InvalidInput));
+        }
+        std::fs::create_dir_all(dir)?;
+
+        let mut newest = None;
+        for index in 0..files {
+            let path = Self::path_of(dir, index);
+            if path
+                .metadata()
+                .map_or(true, |m| m.len() != file_bytes as u64)
+            {
+                continue;
+            }
+            if let Some(seq) = Mapping::open(&path, file_bytes)?.seq() {
+                if newest.map_or(true, |(_, newest)| seq > newest) {
+                    newest = Some((index, seq));
+                }
+            }
+        }
+        let (index, seq) = newest.map_or((0, 0), |(index, seq)| ((index + 1) % files, seq + 1));
+
+        let mut current = Mapping::open(&Self::path_of(dir, index), file_bytes)?;
+        current.reset(seq);
+        Ok(Self {
+            dir: dir.to_path_buf(),
+            file_bytes,
+            files,
+            index,
+            seq,
+            current,
+            buf: Vec::new(),
+        })
+    }
+
+    fn path_of(dir: &Path, index: usize) -> PathBuf {
+        dir.join(format!("fastrace-{index}.ring"))
+    }
+
+    fn rotate(&mut self) -> io::Result<()> {
+        let index = (self.index + 1) % self.files;
+        let mut next = Mapping::open(&Self::path_of(&self.dir, index), self.file_bytes)?;
+        self.seq += 1;
+        next.reset(self.seq);
+        self.index = index;
+        self.current = next;
+        Ok(())
+    }
+
+    /// Appends the record in `buf`, returning whether it was written.
+    fn append(&mut self, used: &mut usize) -> bool {
+        let len = 4 + self.buf.len();
+        if len > self.file_bytes - HEADER_BYTES {
+            return false;
+        }
+        if *used + len > self.file_bytes {
+            self.current.used().store(*used as u64, Ordering::Release);
+            if self.rotate().is_err() {
+                return false;
+            }
+            *used = HEADER_BYTES;
+        }
+        let bytes = self.current.bytes();
+        bytes[*used..*used + 4].copy_from_slice(&(self.buf.len() as u32).to_le_bytes());
+        bytes[*used + 4..*used + len].copy_from_slice(&self.buf);
+        *used += len;
+        true
+    }
+}
+
+impl Reporter for RingReporter {
+    fn report(&mut self, spans: Vec<SpanRecord>) {
+        let mut used = self.current.used().load(Ordering::Relaxed) as usize;
+        let mut dropped = 0;
+        for span in &spans {
+            self.buf.clear();
+            encode(&mut self.buf, span);
+            if !self.append(&mut used) {
+                dropped += 1;
+            }
+        }
+        self.current.used().store(used as u64, Ordering::Release);
+        stats::add_dropped(dropped);
+    }
+}
+
+fn put_varint(buf: &mut Vec<u8>, mut n: u64) {
+    while n >= 0x80 {
+        buf.push(n as u8 | 0x80);
+        n >>= 7;
+    }
+    buf.push(n as u8);
+}
+
+fn put_str(buf: &mut Vec<u8>, s: &str) {
+    put_varint(buf, s.len() as u64);
+    buf.extend_from_slice(s.as_bytes());
+}
+
+fn put_props<K: AsRef<str>, V: AsRef<str>>(buf: &mut Vec<u8>, props: &[(K, V)]) {
+    put_varint(buf, props.len() as u64);
+    for (k, v) in props {
+        put_str(buf, k.as_ref());
+        put_str(buf, v.as_ref());
+    }
+}
+
+fn encode(buf: &mut Vec<u8>, span: &SpanRecord) {
+    buf.extend_from_slice(&span.trace_id.0.to_le_bytes());
+    buf.extend_from_slice(&span.span_id.0.to_le_bytes());
+    buf.extend_from_slice(&span.parent_id.0.to_le_bytes());
+    buf.extend_from_slice(&span.begin_time_unix_ns.to_le_bytes());
+    buf.extend_from_slice(&span.duration_ns.to_le_bytes());
+    put_str(buf, &span.name);
+    put_props(buf, &span.properties);
+    put_varint(buf, span.events.len() as u64);
+    for event in &span.events {
+        put_str(buf, &event.name);
+        buf.extend_from_slice(&event.timestamp_unix_ns.to_le_bytes());
+        put_props(buf, &event.properties);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use std::process::Command;
+
+    use fastrace::collector::{EventRecord, SpanId, TraceId};
+    use serde_json::Value;
+
+    use super::*;
+
+    const FILE_BYTES: usize = 512;
+
+    fn dir(name: &str) -> PathBuf {
+        let dir = std::env::temp_dir().join(format!("fastrace-ring-{}-{name}", std::process::id()));
+        let _ = std::fs::remove_dir_all(&dir);
+        dir
+    }
+
+    fn span(i: u64, name: String) -> SpanRecord {
+        SpanRecord {
+            trace_id: TraceId(0x0102_0304_0506_0708_090a_0b0c_0d0e_0f10),
+            span_id: SpanId(i + 1),
+            parent_id: SpanId(i),
+            begin_time_unix_ns: 1_000 * i,
+            duration_ns: 10,
+            name: name.into(),
+            properties: vec![("k".into(), "v".into())],
+            events: vec![EventRecord {
+                name: "e".into(),
+                timestamp_unix_ns: 1_000 * i + 5,
+                properties: vec![],
+            }],
+        }
+    }
+
+    /// Runs `tools/ring2otlp.py` on `dir`, returning its spans and stderr.
+    fn convert(dir: &Path) -> (Vec<Value>, String) {
+        let output = Command::new("python3")
+            .arg(concat!(env!("CARGO_MANIFEST_DIR"), "/tools/ring2otlp.py"))
+            .arg(dir)
+            .output()
+            .unwrap();
+        assert!(output.status.success());
+        let request: Value = serde_json::from_slice(&output.stdout).unwrap();
+        let spans = request["resourceSpans"][0]["scopeSpans"][0]["spans"]
+            .as_array()
+            .unwrap()
+            .clone();
+        (spans, String::from_utf8(output.stderr).unwrap())
+    }
+
+    fn names(spans: &[Value]) -> Vec<&str> {
+        spans
+            .iter()
+            .map(|span| span["name"].as_str().unwrap())
+            .collect()
+    }
+
+    #[test]
+    fn round_trip() {
+        let dir = dir("round-trip");
+        let mut ring = RingReporter::open(&dir, FILE_BYTES, 2).unwrap();
+        // Enough spans to wrap around both files, with one too large for a
+        // file in the middle.
+        for batch in 0..5 {
+            let mut spans: Vec<_> = (batch * 4..batch * 4 + 4)
+                .map(|i| span(i, format!("span-{i}")))
+                .collect();
+            if batch == 3 {
+                spans.insert(2, span(99, "x".repeat(FILE_BYTES)));
+            }
+            ring.report(spans);
+        }
+
+        let (spans, stderr) = convert(&dir);
+        assert_eq!(stderr, "");
+        // The oldest spans were overwritten, the rest come out in order.
+        let names = names(&spans);
+        let first: u64 = names[0]["span-".len()..].parse().unwrap();
+        assert!(first > 0);
+        let expected: Vec<_> = (first..20).map(|i| format!("span-{i}")).collect();
+        assert_eq!(names, expected);
+
+        let span = &spans[spans.len() - 1];
+        assert_eq!(span["traceId"], "0102030405060708090a0b0c0d0e0f10");
+        assert_eq!(span["spanId"], "0000000000000014");
+        assert_eq!(span["parentSpanId"], "0000000000000013");
+        assert_eq!(span["startTimeUnixNano"], "19000");
+        assert_eq!(span["endTimeUnixNano"], "19010");
+        assert_eq!(span["attributes"][0]["key"], "k");
+        assert_eq!(span["attributes"][0]["value"]["stringValue"], "v");
+        assert_eq!(span["events"][0]["name"], "e");
+        assert_eq!(span["events"][0]["timeUnixNano"], "19005");
+
+        std::fs::remove_dir_all(&dir).unwrap();
+    }
+
+    #[test]
+    fn stops_at_truncated_record() {
+        // A record cut short by its length, then by its content.
+        for (len, content) in [(1000u32, &[][..]), (3, &[0, 0, 0][..])] {
+            let dir = dir("truncated");
+            let mut ring = RingReporter::open(&dir, FILE_BYTES, 2).unwrap();
+            ring.report(vec![span(0, "a".into()), span(1, "b".into())]);
+
+            let used = ring.current.used().load(Ordering::Relaxed) as usize;
+            let bytes = ring.current.bytes();
+            bytes[used..used + 4].copy_from_slice(&len.to_le_bytes());
+            bytes[used + 4..used + 4 + content.len()].copy_from_slice(content);
+            let end = used + 4 + content.len();
+            ring.current.used().store(end as u64, Ordering::Release);
+
+            let (spans, stderr) = convert(&dir);
+            assert_eq!(names(&spans), ["a", "b"]);
+            assert!(stderr.contains("truncated record"), "{stderr}");
+
+            std::fs::remove_dir_all(&dir).unwrap();
+        }
+    }
+}
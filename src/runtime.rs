@@ -0,0 +1,148 @@
+// Copyright 2023 Wenbo Zhang. Licensed under Apache-2.0.
+
+//! The Tokio runtime that drives the OTLP exporters, configured through
+//! `ftr_otlp_exp_cfg`.
+
+use std::{ffi::c_void, mem::transmute, sync::atomic::Ordering};
+
+use once_cell::sync::OnceCell;
+use tokio::runtime::{Builder, Handle, Runtime};
+
+use crate::stats::EXPORTER_THREADS_UNPINNED;
+
+const MODE_MULTI_THREAD: u64 = 0;
+const MODE_CURRENT_THREAD: u64 = 1;
+
+/// Number of CPUs that `RuntimeCfg` can pin threads to.
+const MAX_CPUS: usize = 256;
+
+type RunFn = extern "C" fn(arg: *mut c_void);
+type SpawnFn = extern "C" fn(run: RunFn, arg: *mut c_void, user_data: *mut c_void);
+
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub struct RuntimeCfg {
+    mode: u64,
+    worker_threads: u64,
+    /// Bit set of the CPUs to pin runtime threads to, empty for no pinning.
+    cpus: [u64; MAX_CPUS / 64],
+    /// `SpawnFn` asked to run the runtime on a thread of the application, 0
+    /// to run it on threads of our own.
+    spawn: usize,
+    user_data: usize,
+}
+
+impl Default for RuntimeCfg {
+    fn default() -> Self {
+        Self {
+            mode: MODE_MULTI_THREAD,
+            worker_threads: 2,
+            cpus: [0; MAX_CPUS / 64],
+            spawn: 0,
+            user_data: 0,
+        }
+    }
+}
+
+impl RuntimeCfg {
+    pub fn set_worker_threads(&mut self, n: usize) {
+        self.mode = MODE_MULTI_THREAD;
+        self.worker_threads = n.max(1) as u64;
+    }
+
+    pub fn set_cpus(&mut self, cpus: &[u32]) {
+        self.cpus = [0; MAX_CPUS / 64];
+        for &cpu in cpus.iter().filter(|&&cpu| (cpu as usize) < MAX_CPUS) {
+            self.cpus[cpu as usize / 64] |= 1 << (cpu % 64);
+        }
+    }
+
+    pub fn set_current_thread(&mut self) {
+        self.mode = MODE_CURRENT_THREAD;
+        self.spawn = 0;
+    }
+
+    pub fn set_spawner(&mut self, spawn: usize, user_data: usize) {
+        self.mode = MODE_CURRENT_THREAD;
+        self.spawn = spawn;
+        self.user_data = user_data;
+    }
+
+    /// Pins the calling thread to `cpus`, if any, counting a failure in
+    /// `EXPORTER_THREADS_UNPINNED`.
+    #[cfg(target_os = "linux")]
+    fn pin_thread(&self) {
+        if self.cpus.iter().all(|&word| word == 0) {
+            return;
+        }
+        unsafe {
+            let mut set: libc::cpu_set_t = std::mem::zeroed();
+            for cpu in 0..MAX_CPUS {
+                if self.cpus[cpu / 64] & (1 << (cpu % 64)) != 0 {
+                    libc::CPU_SET(cpu, &mut set);
+                }
+            }
+            // A set without any online CPU fails with EINVAL, leaving the thread
+            // unpinned. Count it rather than losing the isolation silently.
+            if libc::sched_setaffinity(0, std::mem::size_of::<libc::cpu_set_t>(), &set) != 0 {
+                EXPORTER_THREADS_UNPINNED.fetch_add(1, Ordering::Relaxed);
+            }
+        }
+    }
+
+    #[cfg(not(target_os = "linux"))]
+    fn pin_thread(&self) {}
+
+    fn build(&self) -> Handle {
+        let cfg = *self;
+        if self.mode == MODE_MULTI_THREAD {
+            let runtime = Builder::new_multi_thread()
+                .worker_threads(self.worker_threads as usize)
+                .thread_name("fastrace-exporter")
+                .on_thread_start(move || cfg.pin_thread())
+                .enable_all()
+                .build()
+                .expect("Failed to create Tokio runtime");
+            let handle = runtime.handle().clone();
+            // The exporters live as long as the process, and so does their
+            // runtime.
+            std::mem::forget(runtime);
+            return handle;
+        }
+
+        let runtime = Builder::new_current_thread()
+            .enable_all()
+            .build()
+            .expect("Failed to create Tokio runtime");
+        let handle = runtime.handle().clone();
+        let runtime = Box::into_raw(Box::new(runtime)) as *mut c_void;
+        if self.spawn != 0 {
+            let spawn = unsafe { transmute::<usize, SpawnFn>(self.spawn) };
+            spawn(run, runtime, self.user_data as *mut c_void);
+        } else {
+            let runtime = runtime as usize;
+            std::thread::Builder::new()
+                .name("fastrace-exporter".to_string())
+                .spawn(move || {
+                    cfg.pin_thread();
+                    run(runtime as *mut c_void)
+                })
+                .expect("Failed to spawn the exporter thread");
+        }
+        handle
+    }
+}
+
+/// Drives a current-thread runtime on the calling thread. Never returns.
+extern "C" fn run(runtime: *mut c_void) {
+    let runtime = unsafe { &*(runtime as *const Runtime) };
+    runtime.block_on(std::future::pending::<()>())
+}
+
+static HANDLE: OnceCell<Handle> = OnceCell::new();
+
+/// Returns the exporter runtime, building it from `cfg` on first use. Later
+/// configurations are ignored, as all exporters share the runtime.
+pub fn handle(cfg: &RuntimeCfg) -> &'static Handle {
+    HANDLE.get_or_init(|| cfg.build())
+}
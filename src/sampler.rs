@@ -0,0 +1,220 @@
+// Copyright 2023 Wenbo Zhang. Licensed under Apache-2.0.
+
+//! Head sampling of root spans, configured through `ftr_coll_cfg`.
+//!
+//! The configuration is plain data so that it can be copied around by value
+//! on the C side. Installing it builds a `Sampler` that is read without locks
+//! on every root span creation.
+
+use std::{
+    ptr,
+    sync::atomic::{AtomicPtr, AtomicU64, Ordering},
+    time::Instant,
+};
+
+use fastrace::collector::TraceId;
+use once_cell::sync::Lazy;
+
+/// Maximum number of root span names with a policy of their own.
+pub const MAX_ROOT_POLICIES: usize = 8;
+
+/// A sampling policy: a ratio of traces, then a rate limit on the traces kept
+/// by the ratio.
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub struct PolicyCfg {
+    /// Ratio of traces kept, in `[0, 1]`.
+    ratio: f64,
+    /// Traces per second kept at most, 0 for no limit.
+    rate: f64,
+    /// Traces that may be kept at once above `rate`.
+    burst: u64,
+}
+
+impl PolicyCfg {
+    const DEFAULT: Self = Self {
+        ratio: 1.0,
+        rate: 0.0,
+        burst: 1,
+    };
+
+    fn is_default(&self) -> bool {
+        self.ratio >= 1.0 && self.rate <= 0.0
+    }
+}
+
+#[repr(C)]
+#[derive(Clone, Copy)]
+struct RootPolicyCfg {
+    name: Option<&'static str>,
+    policy: PolicyCfg,
+}
+
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub struct SamplerCfg {
+    policy: PolicyCfg,
+    roots: [RootPolicyCfg; MAX_ROOT_POLICIES],
+}
+
+impl Default for SamplerCfg {
+    fn default() -> Self {
+        Self {
+            policy: PolicyCfg::DEFAULT,
+            roots: [RootPolicyCfg {
+                name: None,
+                policy: PolicyCfg::DEFAULT,
+            }; MAX_ROOT_POLICIES],
+        }
+    }
+}
+
+impl SamplerCfg {
+    pub fn set_ratio(&mut self, ratio: f64) {
+        self.policy.ratio = ratio;
+    }
+
+    pub fn set_rate_limit(&mut self, rate: f64, burst: u64) {
+        self.policy.rate = rate;
+        self.policy.burst = burst;
+    }
+
+    pub fn set_root_ratio(&mut self, name: &'static str, ratio: f64) {
+        if let Some(policy) = self.root_policy(name) {
+            policy.ratio = ratio;
+        }
+    }
+
+    pub fn set_root_rate_limit(&mut self, name: &'static str, rate: f64, burst: u64) {
+        if let Some(policy) = self.root_policy(name) {
+            policy.rate = rate;
+            policy.burst = burst;
+        }
+    }
+
+    /// Returns the policy of `name`, adding it if there is room left.
+    fn root_policy(&mut self, name: &'static str) -> Option<&mut PolicyCfg> {
+        let pos = self
+            .roots
+            .iter()
+            .position(|root| root.name.map_or(true, |n| n == name))?;
+        let root = &mut self.roots[pos];
+        root.name = Some(name);
+        Some(&mut root.policy)
+    }
+}
+
+/// Generic cell rate algorithm: a token bucket kept in a single timestamp,
+/// the time at which the bucket would be full again.
+struct RateLimit {
+    interval: u64,
+    tolerance: u64,
+    tat: AtomicU64,
+}
+
+impl RateLimit {
+    fn new(rate: f64, burst: u64) -> Self {
+        let interval = ((1e9 / rate) as u64).max(1);
+        Self {
+            interval,
+            tolerance: interval.saturating_mul(burst.max(1) - 1),
+            tat: AtomicU64::new(0),
+        }
+    }
+
+    fn acquire(&self, now: u64) -> bool {
+        let mut tat = self.tat.load(Ordering::Relaxed);
+        loop {
+            if tat > now.saturating_add(self.tolerance) {
+                return false;
+            }
+            let next = tat.max(now) + self.interval;
+            match self
+                .tat
+                .compare_exchange_weak(tat, next, Ordering::Relaxed, Ordering::Relaxed)
+            {
+                Ok(_) => return true,
+                Err(current) => tat = current,
+            }
+        }
+    }
+}
+
+struct Policy {
+    /// Traces whose id hashes below this are kept, `None` to keep all.
+    threshold: Option<u64>,
+    limit: Option<RateLimit>,
+}
+
+impl Policy {
+    fn new(cfg: &PolicyCfg) -> Self {
+        Self {
+            threshold: (cfg.ratio < 1.0).then(|| (cfg.ratio.max(0.0) * u64::MAX as f64) as u64),
+            limit: (cfg.rate > 0.0).then(|| RateLimit::new(cfg.rate, cfg.burst)),
+        }
+    }
+
+    fn sample(&self, trace_id: TraceId) -> bool {
+        if let Some(threshold) = self.threshold {
+            // Deciding on the trace id keeps the decision consistent across
+            // processes configured with the same ratio.
+            if (trace_id.0 as u64) >= threshold {
+                return false;
+            }
+        }
+        match &self.limit {
+            Some(limit) => limit.acquire(now_ns()),
+            None => true,
+        }
+    }
+}
+
+struct Sampler {
+    policy: Policy,
+    roots: Vec<(&'static str, Policy)>,
+}
+
+static SAMPLER: AtomicPtr<Sampler> = AtomicPtr::new(ptr::null_mut());
+
+static EPOCH: Lazy<Instant> = Lazy::new(Instant::now);
+
+fn now_ns() -> u64 {
+    EPOCH.elapsed().as_nanos() as u64
+}
+
+/// Replaces the sampler used by `sample`.
+///
+/// The previous sampler is leaked, as root spans may still be reading it. The
+/// reporter, and with it the sampler, is normally set once per process.
+pub fn install(cfg: &SamplerCfg) {
+    let roots: Vec<_> = cfg
+        .roots
+        .iter()
+        .filter_map(|root| Some((root.name?, Policy::new(&root.policy))))
+        .collect();
+    let sampler = if cfg.policy.is_default() && roots.is_empty() {
+        ptr::null_mut()
+    } else {
+        Lazy::force(&EPOCH);
+        Box::into_raw(Box::new(Sampler {
+            policy: Policy::new(&cfg.policy),
+            roots,
+        }))
+    };
+    SAMPLER.store(sampler, Ordering::Release);
+}
+
+/// Decides whether a new trace with the given root span is recorded.
+pub fn sample(name: &str, trace_id: TraceId) -> bool {
+    let sampler = SAMPLER.load(Ordering::Acquire);
+    if sampler.is_null() {
+        return true;
+    }
+    let sampler = unsafe { &*sampler };
+    let policy = sampler
+        .roots
+        .iter()
+        .find(|(root, _)| *root == name)
+        .map_or(&sampler.policy, |(_, policy)| policy);
+    policy.sample(trace_id)
+}
@@ -0,0 +1,194 @@
+// Copyright 2023 Wenbo Zhang. Licensed under Apache-2.0.
+
+//! Counters of the spans that went through the collector, read by
+//! `ftr_get_collector_stats`.
+//!
+//! Spans are created on the application threads, so their counter is kept per
+//! thread: each thread only ever writes its own, with plain loads and stores,
+//! and readers add them all up. The other counters are updated once per batch
+//! by the collector and reporter threads.
+
+use std::{
+    sync::{
+        atomic::{AtomicU64, Ordering},
+        Arc, Mutex,
+    },
+    time::Instant,
+};
+
+use fastrace::collector::{Reporter, SpanRecord};
+use once_cell::sync::Lazy;
+
+use crate::{
+    ffi::ftr_collector_stats,
+    queue::{QUEUE_BYTES, QUEUE_SPANS},
+};
+
+/// Number of buckets of the histograms in `ftr_collector_stats`. Must match
+/// `FTR_STATS_BUCKETS`.
+pub const BUCKETS: usize = 24;
+
+/// Spans handed over by fastrace.
+pub static SPANS_COLLECTED: AtomicU64 = AtomicU64::new(0);
+
+/// Spans handed to the reporter.
+pub static SPANS_REPORTED: AtomicU64 = AtomicU64::new(0);
+
+/// Spans lost because the span queue was full.
+pub static SPANS_DROPPED: AtomicU64 = AtomicU64::new(0);
+
+/// Spans of the traces discarded by tail sampling.
+pub static SPANS_SAMPLED_OUT: AtomicU64 = AtomicU64::new(0);
+
+/// Exporter threads left unpinned, see `runtime::RuntimeCfg`.
+pub static EXPORTER_THREADS_UNPINNED: AtomicU64 = AtomicU64::new(0);
+
+/// Batches handed to the reporter, and the time spent reporting them.
+static BATCHES: AtomicU64 = AtomicU64::new(0);
+static EXPORT_NS: AtomicU64 = AtomicU64::new(0);
+
+static BATCH_SIZES: Histogram = Histogram::new();
+static EXPORT_LATENCIES: Histogram = Histogram::new();
+
+/// Power-of-two histogram: bucket `i > 0` counts the values in
+/// `[2^(i-1), 2^i)`, and the last one everything above.
+struct Histogram([AtomicU64; BUCKETS]);
+
+impl Histogram {
+    const fn new() -> Self {
+        #[allow(clippy::declare_interior_mutable_const)]
+        const ZERO: AtomicU64 = AtomicU64::new(0);
+        Self([ZERO; BUCKETS])
+    }
+
+    fn record(&self, value: u64) {
+        let bucket = (64 - value.leading_zeros() as usize).min(BUCKETS - 1);
+        self.0[bucket].fetch_add(1, Ordering::Relaxed);
+    }
+
+    fn load(&self) -> [u64; BUCKETS] {
+        std::array::from_fn(|bucket| self.0[bucket].load(Ordering::Relaxed))
+    }
+}
+
+#[derive(Default)]
+struct ThreadStats {
+    spans_created: AtomicU64,
+}
+
+struct Registry {
+    threads: Vec<Arc<ThreadStats>>,
+    /// Spans created by the threads that exited.
+    retired: u64,
+}
+
+static REGISTRY: Lazy<Mutex<Registry>> = Lazy::new(|| {
+    Mutex::new(Registry {
+        threads: Vec::new(),
+        retired: 0,
+    })
+});
+
+/// Registers the counters of a thread while it lives.
+struct Local(Arc<ThreadStats>);
+
+impl Local {
+    fn new() -> Self {
+        let stats = Arc::new(ThreadStats::default());
+        REGISTRY.lock().unwrap().threads.push(stats.clone());
+        Self(stats)
+    }
+}
+
+impl Drop for Local {
+    fn drop(&mut self) {
+        let mut registry = REGISTRY.lock().unwrap();
+        registry.retired += self.0.spans_created.load(Ordering::Relaxed);
+        registry
+            .threads
+            .retain(|stats| !Arc::ptr_eq(stats, &self.0));
+    }
+}
+
+thread_local! {
+    static LOCAL: Local = Local::new();
+}
+
+/// Counts a span created on the current thread.
+#[inline]
+pub fn span_created() {
+    let _ = LOCAL.try_with(|local| {
+        let created = &local.0.spans_created;
+        created.store(created.load(Ordering::Relaxed) + 1, Ordering::Relaxed);
+    });
+}
+
+pub fn add_dropped(n: usize) {
+    SPANS_DROPPED.fetch_add(n as u64, Ordering::Relaxed);
+}
+
+pub fn add_sampled_out(n: usize) {
+    SPANS_SAMPLED_OUT.fetch_add(n as u64, Ordering::Relaxed);
+}
+
+/// Spans discarded by the collector for any reason.
+pub fn discarded() -> u64 {
+    SPANS_DROPPED.load(Ordering::Relaxed) + SPANS_SAMPLED_OUT.load(Ordering::Relaxed)
+}
+
+pub fn collector_stats() -> ftr_collector_stats {
+    let spans_created = {
+        let registry = REGISTRY.lock().unwrap();
+        registry.retired
+            + registry
+                .threads
+                .iter()
+                .map(|stats| stats.spans_created.load(Ordering::Relaxed))
+                .sum::<u64>()
+    };
+    ftr_collector_stats {
+        spans_created,
+        spans_collected: SPANS_COLLECTED.load(Ordering::Relaxed),
+        spans_reported: SPANS_REPORTED.load(Ordering::Relaxed),
+        spans_dropped: SPANS_DROPPED.load(Ordering::Relaxed),
+        spans_sampled_out: SPANS_SAMPLED_OUT.load(Ordering::Relaxed),
+        queue_spans: QUEUE_SPANS.load(Ordering::Relaxed),
+        queue_bytes: QUEUE_BYTES.load(Ordering::Relaxed),
+        batches: BATCHES.load(Ordering::Relaxed),
+        export_ns: EXPORT_NS.load(Ordering::Relaxed),
+        batch_sizes: BATCH_SIZES.load(),
+        export_latencies_us: EXPORT_LATENCIES.load(),
+        exporter_threads_unpinned: EXPORTER_THREADS_UNPINNED.load(Ordering::Relaxed),
+    }
+}
+
+/// Wraps the reporter chain, counting what fastrace hands over.
+pub struct Collected<R>(pub R);
+
+impl<R: Reporter> Reporter for Collected<R> {
+    fn report(&mut self, spans: Vec<SpanRecord>) {
+        SPANS_COLLECTED.fetch_add(spans.len() as u64, Ordering::Relaxed);
+        self.0.report(spans)
+    }
+}
+
+/// Wraps the reporter set by the application, counting what it is given and
+/// timing it.
+pub struct Counted<R>(pub R);
+
+impl<R: Reporter> Reporter for Counted<R> {
+    fn report(&mut self, spans: Vec<SpanRecord>) {
+        let len = spans.len() as u64;
+        let start = Instant::now();
+        self.0.report(spans);
+        let elapsed = start.elapsed().as_nanos() as u64;
+
+        // Published after the reporter returns, so that a flush reading
+        // `SPANS_REPORTED` sees the spans as reported.
+        BATCHES.fetch_add(1, Ordering::Relaxed);
+        BATCH_SIZES.record(len);
+        EXPORT_NS.fetch_add(elapsed, Ordering::Relaxed);
+        EXPORT_LATENCIES.record(elapsed / 1000);
+        SPANS_REPORTED.fetch_add(len, Ordering::Relaxed);
+    }
+}
@@ -0,0 +1,357 @@
+// Copyright 2023 Wenbo Zhang. Licensed under Apache-2.0.
+
+//! Tail sampling of finished traces, configured through `ftr_coll_cfg`.
+//!
+//! fastrace submits all spans of a trace together once its root span is
+//! dropped, so each batch handed to the reporter holds whole traces. The
+//! filter below decides on every trace of a batch and passes the kept ones on
+//! to the wrapped reporter, before they are converted or serialized.
+
+use std::{
+    borrow::Cow,
+    collections::{HashMap, HashSet},
+};
+
+use fastrace::collector::{Reporter, SpanRecord};
+
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+pub struct TailCfg {
+    /// Traces whose root span lasts at least this long are kept, 0 to disable.
+    min_duration_ns: u64,
+    /// Traces whose root span lasts at least this percentile of the root spans
+    /// with the same name are kept, 0 to disable.
+    percentile: f64,
+    /// Traces with a span carrying this property are kept, unless it is set to
+    /// "false" or "0".
+    error_key: Option<&'static str>,
+}
+
+impl TailCfg {
+    pub fn set_min_duration(&mut self, ns: u64) {
+        self.min_duration_ns = ns;
+    }
+
+    pub fn set_percentile(&mut self, percentile: f64) {
+        self.percentile = percentile;
+    }
+
+    pub fn set_error_key(&mut self, key: &'static str) {
+        self.error_key = Some(key);
+    }
+
+    pub fn is_enabled(&self) -> bool {
+        self.min_duration_ns > 0 || self.percentile > 0.0 || self.error_key.is_some()
+    }
+}
+
+/// Number of root span names tracked separately, the others share one
+/// estimate.
+const MAX_NAMES: usize = 1024;
+
+/// Samples needed before a percentile estimate is used, all traces being
+/// kept until then.
+const MIN_SAMPLES: u32 = 100;
+
+/// Counts are halved once they add up to this, so that estimates follow
+/// changes in latency.
+const DECAY_AT: u32 = 1 << 16;
+
+const SUB_BITS: u32 = 3;
+const BUCKETS: usize = ((64 - SUB_BITS as usize) << SUB_BITS) + (1 << SUB_BITS);
+
+/// Log-linear histogram of durations: each power of two is split into
+/// `1 << SUB_BITS` buckets, and estimates interpolate within a bucket.
+struct Histogram {
+    counts: Box<[u32; BUCKETS]>,
+    total: u32,
+}
+
+impl Histogram {
+    fn new() -> Self {
+        Self {
+            counts: Box::new([0; BUCKETS]),
+            total: 0,
+        }
+    }
+
+    fn bucket(ns: u64) -> usize {
+        if ns < 1 << SUB_BITS {
+            return ns as usize;
+        }
+        let msb = 63 - ns.leading_zeros();
+        let sub = (ns >> (msb - SUB_BITS)) as usize & ((1 << SUB_BITS) - 1);
+        (((msb - SUB_BITS + 1) as usize) << SUB_BITS) + sub
+    }
+
+    fn lower_bound(bucket: usize) -> u64 {
+        if bucket < 1 << SUB_BITS {
+            return bucket as u64;
+        }
+        let msb = (bucket >> SUB_BITS) as u32 + SUB_BITS - 1;
+        let sub = (bucket & ((1 << SUB_BITS) - 1)) as u64;
+        (1 << msb) | (sub << (msb - SUB_BITS))
+    }
+
+    fn record(&mut self, ns: u64) {
+        self.counts[Self::bucket(ns)] += 1;
+        self.total += 1;
+        if self.total >= DECAY_AT {
+            self.total = 0;
+            for count in self.counts.iter_mut() {
+                *count /= 2;
+                self.total += *count;
+            }
+        }
+    }
+
+    fn percentile(&self, percentile: f64) -> Option<u64> {
+        if self.total < MIN_SAMPLES {
+            return None;
+        }
+        let target = percentile * self.total as f64;
+        let mut seen = 0;
+        for (bucket, &count) in self.counts.iter().enumerate() {
+            if count > 0 && (seen + count) as f64 >= target {
+                // Assume durations spread evenly within the bucket.
+                let lower = Self::lower_bound(bucket);
+                let upper = Self::lower_bound(bucket + 1);
+                let fraction = (target - seen as f64) / count as f64;
+                return Some(lower + ((upper - lower) as f64 * fraction) as u64);
+            }
+            seen += count;
+        }
+        None
+    }
+}
+
+/// Wraps a reporter, passing on only the traces kept by `TailCfg`.
+pub struct TailSampler<R> {
+    inner: R,
+    cfg: TailCfg,
+    estimates: HashMap<Cow<'static, str>, Histogram>,
+    others: Histogram,
+}
+
+impl<R: Reporter> TailSampler<R> {
+    pub fn new(inner: R, cfg: TailCfg) -> Self {
+        Self {
+            inner,
+            cfg,
+            estimates: HashMap::new(),
+            others: Histogram::new(),
+        }
+    }
+
+    fn is_error(&self, record: &SpanRecord) -> bool {
+        let Some(key) = self.cfg.error_key else {
+            return false;
+        };
+        record
+            .properties
+            .iter()
+            .any(|(k, v)| k == key && v != "false" && v != "0")
+    }
+
+    /// Decides on a trace from its root span, and feeds the estimates.
+    fn keep_root(&mut self, root: &SpanRecord) -> bool {
+        let duration = root.duration_ns;
+        let mut keep = self.cfg.min_duration_ns > 0 && duration >= self.cfg.min_duration_ns;
+        if self.cfg.percentile > 0.0 {
+            let histogram =
+                if self.estimates.contains_key(&root.name) || self.estimates.len() < MAX_NAMES {
+                    self.estimates
+                        .entry(root.name.clone())
+                        .or_insert_with(Histogram::new)
+                } else {
+                    &mut self.others
+                };
+            // Too few samples to tell the slow ones apart yet, so keep them all.
+            keep |= histogram
+                .percentile(self.cfg.percentile)
+                .map_or(true, |threshold| duration >= threshold);
+            histogram.record(duration);
+        }
+        keep
+    }
+}
+
+impl<R: Reporter> Reporter for TailSampler<R> {
+    fn report(&mut self, mut spans: Vec<SpanRecord>) {
+        let ids: HashSet<(u128, u64)> = spans
+            .iter()
+            .map(|span| (span.trace_id.0, span.span_id.0))
+            .collect();
+
+        let mut keep = HashSet::new();
+        for span in &spans {
+            let is_root = !ids.contains(&(span.trace_id.0, span.parent_id.0));
+            if (is_root && self.keep_root(span)) || self.is_error(span) {
+                keep.insert(span.trace_id.0);
+            }
+        }
+
+        let total = spans.len();
+        spans.retain(|span| keep.contains(&span.trace_id.0));
+        crate::stats::add_sampled_out(total - spans.len());
+        if !spans.is_empty() {
+            self.inner.report(spans);
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use std::sync::{Arc, Mutex};
+
+    use fastrace::collector::{SpanId, TraceId};
+
+    use super::*;
+
+    #[derive(Clone, Default)]
+    struct Sink(Arc<Mutex<Vec<SpanRecord>>>);
+
+    impl Reporter for Sink {
+        fn report(&mut self, spans: Vec<SpanRecord>) {
+            self.0.lock().unwrap().extend(spans)
+        }
+    }
+
+    impl Sink {
+        fn take(&self) -> Vec<(u128, u64)> {
+            let mut spans = self.0.lock().unwrap();
+            spans
+                .drain(..)
+                .map(|span| (span.trace_id.0, span.span_id.0))
+                .collect()
+        }
+    }
+
+    fn span(trace: u128, id: u64, parent: u64, duration_ns: u64) -> SpanRecord {
+        SpanRecord {
+            trace_id: TraceId(trace),
+            span_id: SpanId(id),
+            parent_id: SpanId(parent),
+            duration_ns,
+            name: "root".into(),
+            ..SpanRecord::default()
+        }
+    }
+
+    fn sampler(cfg: impl FnOnce(&mut TailCfg)) -> (TailSampler<Sink>, Sink) {
+        let mut tail = TailCfg::default();
+        cfg(&mut tail);
+        let sink = Sink::default();
+        (TailSampler::new(sink.clone(), tail), sink)
+    }
+
+    #[test]
+    fn bucket_round_trip() {
+        for bucket in 0..BUCKETS {
+            assert_eq!(Histogram::bucket(Histogram::lower_bound(bucket)), bucket);
+        }
+        let mut ns = 1u64;
+        while ns < u64::MAX / 3 {
+            for ns in [ns - 1, ns, ns + 1] {
+                let bucket = Histogram::bucket(ns);
+                assert!(Histogram::lower_bound(bucket) <= ns);
+                assert!(ns < Histogram::lower_bound(bucket + 1));
+            }
+            ns = ns * 3 / 2 + 1;
+        }
+    }
+
+    #[test]
+    fn percentile_interpolates() {
+        let mut histogram = Histogram::new();
+        for _ in 0..MIN_SAMPLES {
+            histogram.record(1000);
+        }
+        // 1000 falls in [960, 1024).
+        assert_eq!(histogram.percentile(0.5), Some(992));
+        assert_eq!(histogram.percentile(1.0), Some(1024));
+
+        let mut histogram = Histogram::new();
+        for ns in 0..MIN_SAMPLES as u64 * 2 {
+            histogram.record(ns % 2 * 4 + 1);
+        }
+        assert_eq!(histogram.percentile(0.25), Some(1));
+        assert_eq!(histogram.percentile(0.75), Some(5));
+    }
+
+    #[test]
+    fn percentile_needs_samples() {
+        let mut histogram = Histogram::new();
+        for _ in 1..MIN_SAMPLES {
+            histogram.record(1000);
+        }
+        assert_eq!(histogram.percentile(0.5), None);
+        histogram.record(1000);
+        assert!(histogram.percentile(0.5).is_some());
+    }
+
+    #[test]
+    fn decay_halves_counts() {
+        let mut histogram = Histogram::new();
+        for _ in 0..DECAY_AT / 2 {
+            histogram.record(10);
+        }
+        for _ in 0..DECAY_AT / 2 {
+            histogram.record(1000);
+        }
+        assert_eq!(histogram.total, DECAY_AT / 2);
+        assert_eq!(histogram.counts[Histogram::bucket(10)], DECAY_AT / 4);
+        assert_eq!(histogram.counts[Histogram::bucket(1000)], DECAY_AT / 4);
+
+        // Later samples now weigh twice as much as the earlier ones.
+        for _ in 0..DECAY_AT / 4 {
+            histogram.record(1000);
+        }
+        assert!(histogram.percentile(0.5).unwrap() >= 960);
+    }
+
+    #[test]
+    fn percentile_keeps_all_while_warming_up() {
+        let (mut tail, sink) = sampler(|cfg| cfg.set_percentile(0.9));
+        for trace in 0..MIN_SAMPLES as u128 {
+            tail.report(vec![span(trace, 1, 0, 1000)]);
+        }
+        assert_eq!(sink.take().len(), MIN_SAMPLES as usize);
+
+        tail.report(vec![span(1000, 1, 0, 1000), span(1001, 1, 0, 1_000_000)]);
+        assert_eq!(sink.take(), vec![(1001, 1)]);
+
+        // A new name warms up on its own.
+        let mut other = span(1002, 1, 0, 1);
+        other.name = "other".into();
+        tail.report(vec![other]);
+        assert_eq!(sink.take(), vec![(1002, 1)]);
+    }
+
+    #[test]
+    fn keeps_whole_traces() {
+        let (mut tail, sink) = sampler(|cfg| {
+            cfg.set_min_duration(1000);
+            cfg.set_error_key("error");
+        });
+        let mut failed = span(3, 31, 30, 1);
+        failed.properties.push(("error".into(), "true".into()));
+        let mut fine = span(4, 41, 40, 1);
+        fine.properties.push(("error".into(), "false".into()));
+        tail.report(vec![
+            // Slow, with a root continued from a remote parent.
+            span(1, 10, 99, 5000),
+            span(1, 11, 10, 1),
+            // Fast.
+            span(2, 20, 0, 10),
+            span(2, 21, 20, 1),
+            // Fast, with an errored child.
+            span(3, 30, 0, 10),
+            failed,
+            // Fast, with a child that did not fail.
+            span(4, 40, 0, 10),
+            fine,
+        ]);
+        assert_eq!(sink.take(), vec![(1, 10), (1, 11), (3, 30), (3, 31)]);
+    }
+}
@@ -0,0 +1,151 @@
+// Copyright 2023 Wenbo Zhang. Licensed under Apache-2.0.
+
+//! Spans recorded after the fact from timestamps taken by the application,
+//! see `ftr_create_child_spans_at`.
+//!
+//! fastrace stamps spans with its own clock, and has no way to create one with
+//! a given start and end. The spans are therefore recorded as local spans
+//! pushed to their parent, which keeps them with their trace through sampling
+//! and batching, each carrying its timestamps in a property. `Timed`, first in
+//! the reporter chain, moves them back to the span record.
+
+use std::{ffi::CStr, fmt::Write};
+
+use fastrace::{
+    collector::{Reporter, SpanRecord},
+    local::LocalCollector,
+    prelude::{LocalSpan, Span},
+};
+
+use crate::ffi::ftr_timed_span;
+
+/// Key of the property holding the timestamps. Starts with a NUL, which keys
+/// given as C strings cannot, and `convert_props` drops for `ftr_prop` keys.
+const TIMESTAMPS: &str = "\0ftr.timestamps";
+
+/// Layout of `ftr_timed_span` as declared in `libfastrace.h`.
+#[repr(C)]
+struct TimedSpan {
+    name: *const u8,
+    start_ns: u64,
+    end_ns: u64,
+}
+
+/// Records `spans` as finished children of `parent`, in one submission.
+pub fn record(parent: &Span, spans: &[ftr_timed_span]) {
+    let spans =
+        unsafe { std::slice::from_raw_parts(spans.as_ptr() as *const TimedSpan, spans.len()) };
+    let collector = LocalCollector::start();
+    for span in spans {
+        let name = unsafe { CStr::from_ptr(span.name as *const _) }
+            .to_str()
+            .unwrap_or("<invalid utf-8>");
+        let _span = LocalSpan::enter_with_local_parent(name).with_property(|| {
+            let mut val = String::with_capacity(41);
+            let _ = write!(val, "{} {}", span.start_ns, span.end_ns);
+            (TIMESTAMPS, val)
+        });
+    }
+    parent.push_child_spans(collector.collect());
+}
+
+/// Parses the value written by `record`.
+fn parse(val: &str) -> Option<(u64, u64)> {
+    let (start, end) = val.split_once(' ')?;
+    Some((start.parse().ok()?, end.parse().ok()?))
+}
+
+/// Applies the timestamps recorded by `record` to the spans carrying them.
+pub struct Timed<R>(pub R);
+
+impl<R: Reporter> Reporter for Timed<R> {
+    fn report(&mut self, mut spans: Vec<SpanRecord>) {
+        for span in &mut spans {
+            // The property is the only one of these spans.
+            if !matches!(span.properties.first(), Some((key, _)) if *key == TIMESTAMPS) {
+                continue;
+            }
+            let Some((start, end)) = parse(&span.properties[0].1) else {
+                continue;
+            };
+            span.properties.remove(0);
+            span.begin_time_unix_ns = start;
+            span.duration_ns = end.saturating_sub(start);
+        }
+        self.0.report(spans)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use std::sync::{Arc, Mutex};
+
+    use fastrace::collector::{Config, SpanContext};
+
+    use super::*;
+
+    #[derive(Clone, Default)]
+    struct Sink(Arc<Mutex<Vec<SpanRecord>>>);
+
+    impl Reporter for Sink {
+        fn report(&mut self, spans: Vec<SpanRecord>) {
+            self.0.lock().unwrap().extend(spans);
+        }
+    }
+
+    fn timed(val: &str) -> SpanRecord {
+        SpanRecord {
+            properties: vec![(TIMESTAMPS.into(), val.to_string().into())],
+            ..SpanRecord::default()
+        }
+    }
+
+    fn apply(span: SpanRecord) -> SpanRecord {
+        let sink = Sink::default();
+        Timed(sink.clone()).report(vec![span]);
+        let mut spans = sink.0.lock().unwrap();
+        spans.pop().unwrap()
+    }
+
+    #[test]
+    fn applies_timestamps() {
+        let span = apply(timed("100 250"));
+        assert_eq!(span.begin_time_unix_ns, 100);
+        assert_eq!(span.duration_ns, 150);
+        assert!(span.properties.is_empty());
+    }
+
+    #[test]
+    fn keeps_malformed_records() {
+        for val in ["", "100", "100 x", "x 250", "100  250"] {
+            let span = timed(val);
+            let reported = apply(span.clone());
+            assert_eq!(reported.begin_time_unix_ns, span.begin_time_unix_ns);
+            assert_eq!(reported.duration_ns, span.duration_ns);
+            assert_eq!(reported.properties, span.properties);
+        }
+    }
+
+    #[test]
+    fn records_given_timestamps() {
+        let sink = Sink::default();
+        fastrace::set_reporter(Timed(sink.clone()), Config::default());
+        {
+            let root = Span::root("root", SpanContext::random());
+            let span = TimedSpan {
+                name: b"timed\0".as_ptr(),
+                start_ns: 1_000_000_007,
+                end_ns: 1_000_000_507,
+            };
+            let span: ftr_timed_span = unsafe { std::mem::transmute(span) };
+            record(&root, &[span]);
+        }
+        fastrace::flush();
+
+        let spans = sink.0.lock().unwrap();
+        let span = spans.iter().find(|span| span.name == "timed").unwrap();
+        assert_eq!(span.begin_time_unix_ns, 1_000_000_007);
+        assert_eq!(span.duration_ns, 500);
+        assert!(span.properties.is_empty());
+    }
+}
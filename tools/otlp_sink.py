@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+# Copyright 2023 Wenbo Zhang. Licensed under Apache-2.0.
+
+"""Stand-in OTLP/HTTP collector that writes the batches it receives to disk.
+
+Point an exporter configured with `ftr_set_otlp_protocol(cfg,
+FTR_OTLP_HTTP_PROTOBUF)` at it to check what is sent without running a real
+collector:
+
+    tools/otlp_sink.py --port 4318 --out /tmp/otlp
+    OTEL_EXPORTER_OTLP_ENDPOINT=http://127.0.0.1:4318 ./build/examples/...
+
+Each request body is decompressed according to its Content-Encoding and saved
+as an ExportTraceServiceRequest protobuf, `batch-<n>.pb`. One line per batch
+is printed with its size on the wire and once decompressed. zstd needs the
+`zstandard` module.
+"""
+
+import argparse
+import gzip
+import os
+import sys
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from itertools import count
+
+
+def decompress(encoding, body):
+    if encoding in ("", "identity"):
+        return body
+    if encoding == "gzip":
+        return gzip.decompress(body)
+    if encoding == "zstd":
+        import zstandard
+
+        return zstandard.ZstdDecompressor().decompressobj().decompress(body)
+    raise ValueError(f"unsupported Content-Encoding: {encoding}")
+
+
+def handler(out, batches):
+    class Handler(BaseHTTPRequestHandler):
+        def do_POST(self):
+            body = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+            encoding = self.headers.get("Content-Encoding", "").lower()
+            try:
+                data = decompress(encoding, body)
+            except Exception as e:
+                self.send_error(400, str(e))
+                return
+
+            n = next(batches)
+            path = os.path.join(out, f"batch-{n:06}.pb")
+            with open(path, "wb") as f:
+                f.write(data)
+            print(
+                f"{path}: {self.path} {encoding or 'identity'} "
+                f"{len(body)} -> {len(data)} bytes",
+                flush=True,
+            )
+
+            # An empty ExportTraceServiceResponse: every span was accepted.
+            self.send_response(200)
+            self.send_header("Content-Type", "application/x-protobuf")
+            self.send_header("Content-Length", "0")
+            self.end_headers()
+
+        def log_message(self, format, *args):
+            pass
+
+    return Handler
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=4318)
+    parser.add_argument("--out", default="otlp-batches")
+    args = parser.parse_args()
+
+    os.makedirs(args.out, exist_ok=True)
+    server = ThreadingHTTPServer(
+        (args.host, args.port), handler(args.out, count())
+    )
+    print(f"listening on http://{args.host}:{args.port}", file=sys.stderr)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
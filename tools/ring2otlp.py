@@ -0,0 +1,164 @@
+#!/usr/bin/env python3
+# Copyright 2023 Wenbo Zhang. Licensed under Apache-2.0.
+
+"""Converts the files of `ftr_set_ring_rptr` to OTLP JSON.
+
+    tools/ring2otlp.py /var/tmp/traces > traces.json
+    curl -H 'Content-Type: application/json' --data-binary @traces.json \\
+        http://127.0.0.1:4318/v1/traces
+
+The output is one ExportTraceServiceRequest holding the spans of every file
+in `dir`, oldest first. The file format is described in `src/ring.rs`.
+"""
+
+import argparse
+import glob
+import json
+import os
+import struct
+import sys
+
+MAGIC = b"FTRRING\0"
+VERSION = 1
+HEADER = struct.Struct("<8sIIQQ")
+SPAN = struct.Struct("<16sQQQQ")
+
+
+class Truncated(Exception):
+    """A record ends before its last field."""
+
+
+class Reader:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def take(self, n):
+        if n > len(self.data) - self.pos:
+            raise Truncated
+        chunk = self.data[self.pos : self.pos + n]
+        self.pos += n
+        return chunk
+
+    def u64(self):
+        return struct.unpack("<Q", self.take(8))[0]
+
+    def varint(self):
+        n, shift = 0, 0
+        while True:
+            # A u64 takes at most 10 bytes.
+            if self.pos == len(self.data) or shift > 63:
+                raise Truncated
+            byte = self.data[self.pos]
+            self.pos += 1
+            n |= (byte & 0x7F) << shift
+            if byte < 0x80:
+                return n
+            shift += 7
+
+    def str(self):
+        return self.take(self.varint()).decode("utf-8", "replace")
+
+    def props(self):
+        return [
+            {"key": self.str(), "value": {"stringValue": self.str()}}
+            for _ in range(self.varint())
+        ]
+
+
+def read_span(record):
+    r = Reader(record)
+    trace_id, span_id, parent_id, begin, duration = SPAN.unpack(
+        r.take(SPAN.size)
+    )
+    span = {
+        # Little-endian u128 in the file, big-endian hex in OTLP.
+        "traceId": trace_id[::-1].hex(),
+        "spanId": f"{span_id:016x}",
+        "name": r.str(),
+        "kind": 2,
+        "startTimeUnixNano": str(begin),
+        "endTimeUnixNano": str(begin + duration),
+    }
+    if parent_id:
+        span["parentSpanId"] = f"{parent_id:016x}"
+    span["attributes"] = r.props()
+    span["events"] = [
+        {"name": r.str(), "timeUnixNano": str(r.u64()), "attributes": r.props()}
+        for _ in range(r.varint())
+    ]
+    return span
+
+
+def read_file(path):
+    """Returns the sequence number and the spans of a ring file."""
+    with open(path, "rb") as f:
+        data = f.read()
+    if len(data) < HEADER.size:
+        return None
+    magic, version, _, seq, used = HEADER.unpack_from(data)
+    if magic != MAGIC or version != VERSION:
+        return None
+    end = min(used, len(data))
+    spans, pos = [], HEADER.size
+    while pos < end:
+        # Stop at the last complete record, e.g. of a file being overwritten.
+        try:
+            if pos + 4 > end:
+                raise Truncated
+            (n,) = struct.unpack_from("<I", data, pos)
+            if pos + 4 + n > end:
+                raise Truncated
+            spans.append(read_span(data[pos + 4 : pos + 4 + n]))
+        except Truncated:
+            print(
+                f"{path}: truncated record at offset {pos}, "
+                f"{len(spans)} spans read",
+                file=sys.stderr,
+            )
+            break
+        pos += 4 + n
+    return seq, spans
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("dir", help="directory given to ftr_set_ring_rptr")
+    parser.add_argument("--service", default="unknown", help="service.name")
+    args = parser.parse_args()
+
+    files = []
+    for path in glob.glob(os.path.join(args.dir, "fastrace-*.ring")):
+        ring = read_file(path)
+        if ring is None:
+            print(f"{path}: not a ring file, skipped", file=sys.stderr)
+        else:
+            files.append(ring)
+    files.sort(key=lambda ring: ring[0])
+
+    request = {
+        "resourceSpans": [
+            {
+                "resource": {
+                    "attributes": [
+                        {
+                            "key": "service.name",
+                            "value": {"stringValue": args.service},
+                        }
+                    ]
+                },
+                "scopeSpans": [
+                    {
+                        "scope": {"name": "libfastrace"},
+                        "spans": [span for _, spans in files for span in spans],
+                    }
+                ],
+            }
+        ]
+    }
+    json.dump(request, sys.stdout)
+    sys.stdout.write("\n")
+
+
+if __name__ == "__main__":
+    main()